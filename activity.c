@@ -0,0 +1,104 @@
+/*
+ * activity.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "activity.h"
+
+/* noise floor of tiny or very static frames, relative to mean size */
+#define ACTIVITY_FLOOR 0.002
+
+void activity_init(ACTIVITY *a, int fps, double threshold)
+{
+	a->threshold = threshold > 0 ? threshold : ACTIVITY_THRESHOLD;
+	a->alpha = 1.0 / (fps * ACTIVITY_WINDOW);
+	a->base = a->mean = 0;
+	a->seen = 0;
+	a->hold = fps * ACTIVITY_HOLD;
+	a->prev = 0;
+	a->open = 0;
+}
+
+static void activity_event(const ACTIVITY *a, EVTS *event)
+{
+	double score = a->peak * 10 + 0.5;
+	event->start = a->start;
+	event->frames = a->last - a->start + 1;
+	event->stream = 0;
+	event->score = score > UINT16_MAX ? UINT16_MAX : (uint16_t)score;
+}
+
+int activity_frame(ACTIVITY *a, long frame, size_t size, EVTS *event)
+{
+	double delta, floor, score = 0, alpha;
+	int ended = 0;
+
+	/* missing frames tell nothing, players hold previous one */
+	if(size == 0) return 0;
+	if(a->open && frame - a->last > a->hold) {
+		activity_event(a, event);
+		a->open = 0;
+		ended = 1;
+	}
+	if(a->prev) {
+		delta = size > a->prev ? size - a->prev : a->prev - size;
+		floor = a->mean * ACTIVITY_FLOOR;
+		/* first window is plain average, so baseline settles quickly and
+		 * scoring starts after a second */
+		alpha = a->seen * a->alpha < 1 ? 1.0 / (a->seen + 1) : a->alpha;
+		if(a->seen >= a->hold) score = delta / (a->base > floor ? a->base : floor);
+		if(score >= a->threshold) {
+			if(!a->open) {
+				a->open = 1;
+				a->start = frame;
+				a->peak = 0;
+			}
+			a->last = frame;
+			if(score > a->peak) a->peak = score;
+		} else {
+			/* active frames stay out of baseline, motion does not hide itself */
+			a->base += (delta - a->base) * alpha;
+			a->seen++;
+		}
+	}
+	a->mean += (size - a->mean) * (a->prev ? a->alpha : 1);
+	a->prev = size;
+	return ended;
+}
+
+int activity_pending(const ACTIVITY *a, EVTS *event)
+{
+	if(!a->open) return 0;
+	activity_event(a, event);
+	return 1;
+}
+
+void activity_split(ACTIVITY *a, long frames)
+{
+	a->last -= frames;
+	a->start = 0;
+}
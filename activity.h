@@ -0,0 +1,64 @@
+/*
+ * activity.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define ACTIVITY_THRESHOLD 4.0  /* default score making frame active */
+#define ACTIVITY_WINDOW    10   /* seconds of quiet frames in baseline */
+#define ACTIVITY_HOLD      1    /* seconds of quiet frames ending event */
+
+/* Entry of private `evts' chunk, one per event in order of its end. */
+typedef struct {
+	uint32_t start;  /* first active frame */
+	uint32_t frames; /* up to and including last active frame */
+	uint16_t stream;
+	uint16_t score;  /* peak score in tenths */
+} __attribute__((packed)) EVTS;
+
+/* Motion detector of single stream working on frame sizes only. Size
+ * change against previous frame is scored in units of rolling mean change
+ * over quiet frames, frames scoring at least threshold are active and
+ * active frames closer than ACTIVITY_HOLD seconds form single event. */
+typedef struct {
+	double threshold;
+	double alpha;    /* baseline smoothing of ACTIVITY_WINDOW seconds */
+	double base;     /* mean size change of quiet frames */
+	double mean;     /* mean frame size */
+	long   seen;     /* frames in baseline */
+	long   hold;     /* quiet frames ending event */
+	size_t prev;     /* size of previous frame, 0 for none */
+	int    open;     /* event in progress */
+	long   start, last;
+	double peak;
+} ACTIVITY;
+
+void activity_init(ACTIVITY *a, int fps, double threshold);
+/* Scores frame of given number and size. Returns 1 and fills event when
+ * it ends an event. */
+int activity_frame(ACTIVITY *a, long frame, size_t size, EVTS *event);
+/* Fills event still in progress, returns 0 when there is none. */
+int activity_pending(const ACTIVITY *a, EVTS *event);
+/* Continues detection in new file starting after given number of frames,
+ * event in progress restarts at its first frame. */
+void activity_split(ACTIVITY *a, long frames);
@@ -0,0 +1,632 @@
+/*
+ * batch.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "riff.h"
+#include "mp3.h"
+#include "jpeg.h"
+#include "throttle.h"
+#include "frames.h"
+#include "writer.h"
+#include "stats.h"
+#include "activity.h"
+#include "mux.h"
+#include "batch.h"
+
+#define BATCH_PROGRESS 500000000ull /* ns between progress replies */
+#define BATCH_STOP_POLL 200          /* ms between stop checks while workers are busy */
+#define BATCH_MAX_FRAME (64u << 20)  /* largest frame sent in-band */
+
+/* Soundtrack loaded and parsed once, jobs read it from memory. */
+typedef struct BATCH_AUDIO {
+	char       *path;
+	uint8_t    *data;
+	size_t      size;
+	MUX         parsed;
+	struct BATCH_AUDIO *next;
+} BATCH_AUDIO;
+
+/* Frame data sent in-band. */
+typedef struct {
+	size_t       size;
+	uint8_t      data[];
+} BATCH_FRAME;
+
+typedef struct {
+	char        *line;
+	const char  *out, *list;
+	const char **paths;    /* frame list sent in-band, NULL to read list */
+	int          count;
+	BATCH_FRAME **data;    /* frame data sent in-band instead of paths */
+	int          dataCount;
+	int          fps;
+	const char  *audioPath;
+	BATCH_AUDIO *audio;    /* shared soundtrack, NULL when it cannot be loaded */
+	FILE        *client;   /* daemon client receiving progress */
+	uint64_t     progress; /* time of last progress reply */
+
+	/* status */
+	const char  *error;    /* message format with single %s */
+	const char  *errorArg;
+	uint32_t     frames;
+	uint64_t     bytes;
+	double       seconds;
+	STATS        stats;
+} BATCH_JOB;
+
+typedef struct {
+	const BATCH *b;
+	BATCH_JOB   *jobs;
+	BATCH_AUDIO *audios; /* loaded soundtracks, kept warm by daemon */
+	pthread_mutex_t lock;
+	int          count;
+	int          next;   /* next job to take, shared by workers */
+	int          done;
+	int          failed;
+
+	/* daemon, accepted connection handed over to idle worker */
+	pthread_cond_t cond;
+	int          client; /* -1 when none is waiting */
+	int         *serving; /* connection of each worker, -1 for none */
+	int          quit;
+} BATCH_RUN;
+
+static int batch_audio_load(BATCH_AUDIO *a, int fps)
+{
+	FILE *in;
+	long size;
+	mux_init(&a->parsed, fps);
+	if(!(in = fopen(a->path, "rb"))) return 0;
+	if(fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) > 0 && (a->data = malloc(size))) {
+		fseek(in, 0, SEEK_SET);
+		a->size = fread(a->data, 1, size, in);
+	}
+	fclose(in);
+	if(!a->size || !(in = fmemopen(a->data, a->size, "rb"))) {
+		free(a->data), a->data = NULL;
+		return 0;
+	}
+	mux_audio_stream(&a->parsed, in, a->path);
+	return 1;
+}
+
+/* Returns soundtrack loaded for earlier job or loads it, NULL when it cannot
+ * be loaded, so it is tried again next time. */
+static BATCH_AUDIO *batch_audio(BATCH_RUN *r, const char *path)
+{
+	BATCH_AUDIO *a;
+	pthread_mutex_lock(&r->lock);
+	for(a = r->audios; a && strcmp(a->path, path); a = a->next);
+	if(!a && (a = calloc(1, sizeof(BATCH_AUDIO)))) {
+		if((a->path = strdup(path)) && batch_audio_load(a, r->b->fps)) {
+			a->next = r->audios;
+			r->audios = a;
+		} else {
+			free(a->path);
+			free(a);
+			a = NULL;
+		}
+	}
+	pthread_mutex_unlock(&r->lock);
+	return a;
+}
+
+static void batch_audio_free(BATCH_RUN *r)
+{
+	BATCH_AUDIO *a;
+	while((a = r->audios)) {
+		r->audios = a->next;
+		if(a->parsed.snd) fclose(a->parsed.snd);
+		free(a->data);
+		free(a->path);
+		free(a);
+	}
+}
+
+/* Fills job from manifest line, returns 0 for empty and comment lines and
+ * -1 for invalid ones. */
+static int batch_parse(BATCH_RUN *r, BATCH_JOB *job, const char *line)
+{
+	char *save, *fps, *audio;
+	memset(job, 0, sizeof(*job));
+	if(!(job->line = strdup(line))) return -1;
+	if(!(job->out = strtok_r(job->line, " \t\r\n", &save)) || *job->out == '#') {
+		free(job->line);
+		return 0;
+	}
+	if(!(job->list = strtok_r(NULL, " \t\r\n", &save))) return -1;
+	fps = strtok_r(NULL, " \t\r\n", &save);
+	job->fps = fps && strcmp(fps, "-") ? atoi(fps) : r->b->fps;
+	if(job->fps <= 0) job->fps = r->b->fps;
+	/* same soundtrack is shared by all jobs */
+	if((audio = strtok_r(NULL, " \t\r\n", &save))) job->audio = batch_audio(r, job->audioPath = audio);
+	return 1;
+}
+
+static void batch_progress(MUX *m, void *arg)
+{
+	BATCH_JOB *job = arg;
+	uint64_t now = stats_now();
+	if(now - job->progress < BATCH_PROGRESS) return;
+	job->progress = now;
+	fprintf(job->client, "progress %s %u %u\n", job->out, m->frames, m->totalFrames);
+	fflush(job->client);
+}
+
+/* Muxes frames from memory, re-encoding them one by one like live parts. */
+static void batch_mux_frames(MUX *m, BATCH_FRAME *const *frames, int count)
+{
+	const void *data;
+	size_t size, optSize, optCap = 0;
+	uint8_t *opt = NULL;
+	uint64_t frameStart;
+	int i;
+	for(i = 0; i < count; i++) {
+		frameStart = STATS_START(m->stats);
+		data = frames[i]->data, size = frames[i]->size;
+		if(m->optimize) {
+			m->optimizeIn += size;
+			if((optSize = jpeg_optimize(data, size, &opt, &optCap))) data = opt, size = optSize;
+			m->optimizeOut += size;
+		}
+		mux_frame(m, data, size);
+		stats_frame(m->stats, frameStart);
+	}
+	free(opt);
+}
+
+#define JOB_FAIL(job, msg, arg) do { (job)->error = (msg); (job)->errorArg = (arg); goto done; } while(0)
+
+static void batch_job(BATCH_RUN *r, BATCH_JOB *job)
+{
+	const char **paths = NULL, **selected = NULL;
+	BATCH_FRAME **data = job->data;
+	int count = 0, frames, width, height, i;
+	uint64_t start = stats_now();
+	FILE *out = NULL;
+	WRITER *writer;
+	MUX mux;
+
+	stats_init(&job->stats);
+	mux_init(&mux, job->fps);
+	/* daemon clients always get stats back */
+	mux.stats = r->b->statsFormat || job->client ? &job->stats : NULL;
+	mux.checksums = r->b->checksums;
+	/* jobs already run in parallel, one re-encoding thread each */
+	mux.optimize = r->b->optimize;
+	mux.seekmap = r->b->seekmap;
+	mux.fastStart = r->b->fastStart;
+	mux.events = r->b->events;
+	mux.path = job->out;
+	/* limits are shared, all jobs together stay within them */
+	mux.readLimit = r->b->readLimit;
+	mux.writeLimit = r->b->writeLimit;
+	if(job->client) {
+		mux.progress = batch_progress;
+		mux.progressArg = job;
+	}
+
+	/* in-band list is taken over and freed like one read from file */
+	paths = job->paths, count = job->count;
+	job->paths = NULL, job->data = NULL;
+	if(count && data) JOB_FAIL(job, "Frame paths and data mixed in `%s'", job->list);
+	if(data) {
+		/* selection only moves pointers, frames are stored through char
+		 * pointers and converted back */
+		if(!(selected = malloc(job->dataCount * sizeof(char *)))) JOB_FAIL(job, "Cannot allocate frame list `%s'", job->list);
+		for(i = 0; i < job->dataCount; i++) selected[i] = (const char *)data[i];
+		frames = frames_select(selected, job->dataCount, r->b->every, r->b->duration * job->fps);
+		if(!jpeg_size_data(data[0]->data, data[0]->size, &width, &height)) JOB_FAIL(job, "Invalid JPEG data in `%s'", job->list);
+	} else {
+		if(!paths && !frames_list(job->list, &paths, &count)) JOB_FAIL(job, "Cannot read frame list `%s'", job->list);
+		if(count == 0) JOB_FAIL(job, "Empty frame list `%s'", job->list);
+		/* paths stay owned by the list, selection only refers to them */
+		if(!(selected = malloc(count * sizeof(char *)))) JOB_FAIL(job, "Cannot allocate frame list `%s'", job->list);
+		memcpy(selected, paths, count * sizeof(char *));
+		frames = frames_select(selected, count, r->b->every, r->b->duration * job->fps);
+		if(!jpeg_size(selected[0], &width, &height)) JOB_FAIL(job, "Invalid JPEG file `%s'", selected[0]);
+	}
+	writer_throttle(writer = writer_open(job->out, r->b->bufSize, r->b->writerFlags), mux.writeLimit);
+	if(!(out = writer_file(writer))) JOB_FAIL(job, "Cannot open output `%s'", job->out);
+
+	if(job->audioPath) {
+		BATCH_AUDIO *a = job->audio;
+		if(!a) JOB_FAIL(job, "Cannot open input `%s'", job->audioPath);
+		/* unsupported format was already reported, muxed without audio */
+		if(a->parsed.snd) {
+			mux_audio_share(&mux, &a->parsed, fmemopen(a->data, a->size, "rb"));
+			if(!mux.snd) JOB_FAIL(job, "Cannot open input `%s'", a->path);
+		}
+	}
+
+	mux.vids[0].width = width;
+	mux.vids[0].height = height;
+	mux.totalFrames = frames;
+	if(!mux_begin(&mux, out)) JOB_FAIL(job, "Cannot create temporary index for `%s'", job->out);
+	if(data) batch_mux_frames(&mux, (BATCH_FRAME *const *)selected, frames);
+	else if(!mux_paths(&mux, selected, frames, r->b->backend)) JOB_FAIL(job, "Cannot allocate frame reader for `%s'", job->out);
+	mux_end(&mux);
+	job->frames = mux.frames;
+	job->bytes = ftell(out);
+
+done:
+	if(mux.snd) fclose(mux.snd);
+	if(mux.idx) fclose(mux.idx);
+	if(mux.crc) fclose(mux.crc);
+	if(mux.seek) fclose(mux.seek);
+	if(mux.evts) fclose(mux.evts);
+	if(out && fclose(out) && !job->error) {
+		job->error = "Cannot write output `%s'";
+		job->errorArg = job->out;
+	}
+	for(i = 0; i < count; i++) free((char *)paths[i]);
+	free(paths);
+	for(i = 0; i < job->dataCount; i++) free(data[i]);
+	free(data);
+	free(selected);
+	job->seconds = (stats_now() - start) / 1e9;
+}
+
+static void batch_status(BATCH_RUN *r, BATCH_JOB *job)
+{
+	/* keep lines of concurrent jobs together */
+	flockfile(stderr);
+	r->done++;
+	if(job->error) {
+		r->failed++;
+		if(r->jobs) fprintf(stderr, "Error: Job %d/%d `%s': ", r->done, r->count, job->out);
+		else fprintf(stderr, "Error: Job %d `%s': ", r->done, job->out);
+		fprintf(stderr, job->error, job->errorArg);
+		fprintf(stderr, ".\n");
+	} else {
+		if(r->jobs) fprintf(stderr, "Job %d/%d `%s' ", r->done, r->count, job->out);
+		else fprintf(stderr, "Job %d `%s' ", r->done, job->out);
+		fprintf(stderr, "%u frames, %llu bytes in %.3f s\n",
+			job->frames, (unsigned long long)job->bytes, job->seconds);
+		if(r->b->statsFormat) stats_print(&job->stats, stderr, r->b->statsFormat);
+	}
+	funlockfile(stderr);
+}
+
+static void *batch_worker(void *arg)
+{
+	BATCH_RUN *r = arg;
+	int i;
+	while((i = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED)) < r->count) {
+		batch_job(r, &r->jobs[i]);
+		batch_status(r, &r->jobs[i]);
+	}
+	return NULL;
+}
+
+int batch_run(const BATCH *b, const char *manifest)
+{
+	FILE *in = strcmp(manifest, "-") ? fopen(manifest, "r") : stdin;
+	BATCH_RUN run;
+	int alloc = 0, threads = b->threads, i, ret;
+	pthread_t *workers;
+	char *line = NULL;
+	size_t cap = 0;
+	uint64_t start = stats_now();
+
+	if(!in) return -1;
+	memset(&run, 0, sizeof(run));
+	run.b = b;
+	pthread_mutex_init(&run.lock, NULL);
+
+	/* parse manifest */
+	while(getline(&line, &cap, in) >= 0) {
+		BATCH_JOB *job;
+		if(run.count >= alloc) {
+			BATCH_JOB *grown = realloc(run.jobs, (alloc = alloc ? alloc * 2 : 256) * sizeof(BATCH_JOB));
+			if(!grown) break;
+			run.jobs = grown;
+		}
+		job = &run.jobs[run.count];
+		if((ret = batch_parse(&run, job, line)) < 0) {
+			fprintf(stderr, "Error: Missing frame list for `%s' in manifest `%s'.\n", job->out, manifest);
+			free(job->line);
+			continue;
+		}
+		if(ret == 0) continue;
+		if(job->audioPath && !job->audio) {
+			fprintf(stderr, "Error: Cannot open input `%s'.\n", job->audioPath);
+		}
+		run.count++;
+	}
+	free(line);
+	if(in != stdin) fclose(in);
+
+	if(threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads > run.count) threads = run.count;
+	if(threads < 1) threads = 1;
+	fprintf(stderr, "Batch `%s' %d jobs on %d threads\n", manifest, run.count, threads);
+
+	/* bounded pool, each worker takes next job until none are left */
+	if((workers = calloc(threads, sizeof(pthread_t)))) {
+		for(i = 0; i < threads; i++) {
+			if(pthread_create(&workers[i], NULL, batch_worker, &run)) break;
+		}
+		if(i == 0) batch_worker(&run);
+		while(i-- > 0) pthread_join(workers[i], NULL);
+		free(workers);
+	} else {
+		batch_worker(&run);
+	}
+
+	fprintf(stderr, "Batch `%s' %d jobs, %d failed in %.3f s\n", manifest, run.count, run.failed, (stats_now() - start) / 1e9);
+
+	for(i = 0; i < run.count; i++) free(run.jobs[i].line);
+	free(run.jobs);
+	batch_audio_free(&run);
+	pthread_mutex_destroy(&run.lock);
+	return run.failed;
+}
+
+/* Runs jobs sent over one connection, one after another. */
+static void batch_client(BATCH_RUN *r, int fd)
+{
+	FILE *in = fdopen(fd, "r"), *out = NULL;
+	char *line = NULL;
+	size_t cap = 0;
+	int dupFd = dup(fd), broken = 0, ret, i;
+
+	if(!in || dupFd < 0 || !(out = fdopen(dupFd, "w"))) {
+		if(in) fclose(in);
+		else close(fd);
+		if(dupFd >= 0) close(dupFd);
+		return;
+	}
+	while(getline(&line, &cap, in) >= 0) {
+		BATCH_JOB job;
+		if((ret = batch_parse(r, &job, line)) < 0) {
+			fprintf(out, "error %s Missing frame list\n", job.out ?: "-");
+			fflush(out);
+			free(job.line);
+			continue;
+		}
+		if(ret == 0) continue;
+		if(!strcmp(job.list, "-")) {
+			/* paths or `=bytes' lines with frame data follow the request up
+			 * to line with single dot */
+			int alloc = 0, dataAlloc = 0;
+			while(getline(&line, &cap, in) >= 0 && strcmp(line, ".\n") && strcmp(line, ".\r\n")) {
+				if(*line == '=') {
+					char *end;
+					unsigned long long size = strtoull(line + 1, &end, 10);
+					BATCH_FRAME *frame = NULL;
+					/* data cannot be skipped without its size, connection
+					 * is dropped */
+					if(end == line + 1 || (*end && *end != '\r' && *end != '\n') || !size || size > BATCH_MAX_FRAME ||
+					   !(frame = malloc(sizeof(BATCH_FRAME) + size)) || fread(frame->data, 1, size, in) != size) {
+						free(frame);
+						broken = 1;
+						break;
+					}
+					frame->size = size;
+					if(job.dataCount >= dataAlloc) {
+						BATCH_FRAME **grown = realloc(job.data, (dataAlloc = dataAlloc ? dataAlloc * 2 : 256) * sizeof(BATCH_FRAME *));
+						if(!grown) {
+							free(frame);
+							broken = 1;
+							break;
+						}
+						job.data = grown;
+					}
+					job.data[job.dataCount++] = frame;
+					continue;
+				}
+				if(job.count >= alloc) {
+					const char **grown = realloc(job.paths, (alloc = alloc ? alloc * 2 : 256) * sizeof(char *));
+					if(!grown) break;
+					job.paths = grown;
+				}
+				line[strcspn(line, "\r\n")] = '\0';
+				if(*line && !(job.paths[job.count++] = strdup(line))) job.count--;
+			}
+			job.list = "(in-band)";
+		}
+		if(broken) {
+			fprintf(out, "error %s Invalid frame data\n", job.out);
+			fflush(out);
+			for(i = 0; i < job.count; i++) free((char *)job.paths[i]);
+			free(job.paths);
+			for(i = 0; i < job.dataCount; i++) free(job.data[i]);
+			free(job.data);
+			free(job.line);
+			break;
+		}
+		job.client = out;
+		job.progress = stats_now();
+		batch_job(r, &job);
+		batch_status(r, &job);
+		if(job.error) {
+			fprintf(out, "error %s ", job.out);
+			fprintf(out, job.error, job.errorArg);
+			fprintf(out, "\n");
+		} else {
+			fprintf(out, "done %s %u %llu %.3f\n", job.out, job.frames, (unsigned long long)job.bytes, job.seconds);
+			fprintf(out, "stats %s ", job.out);
+			stats_print(&job.stats, out, STATS_JSON);
+		}
+		fflush(out);
+		free(job.line);
+	}
+	free(line);
+	fclose(out);
+	fclose(in);
+}
+
+static void *batch_server_worker(void *arg)
+{
+	BATCH_RUN *r = arg;
+	int fd, slot;
+	pthread_mutex_lock(&r->lock);
+	for(slot = 0; r->serving[slot] != -1; slot++);
+	r->serving[slot] = -2;
+	for(;;) {
+		while(r->client < 0 && !r->quit) pthread_cond_wait(&r->cond, &r->lock);
+		/* connection accepted but not taken yet is dropped on stop */
+		if(r->quit) break;
+		fd = r->serving[slot] = r->client;
+		r->client = -1;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+		batch_client(r, fd);
+		pthread_mutex_lock(&r->lock);
+		r->serving[slot] = -2;
+	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
+
+int batch_serve(const BATCH *b, const char *path, volatile sig_atomic_t *stop)
+{
+	struct sockaddr_un addr;
+	BATCH_RUN run;
+	pthread_t *workers;
+	sigset_t block, prev;
+	struct stat st;
+	mode_t mask;
+	int fd, threads = b->threads, i;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr.sun_path)) return 0;
+	strcpy(addr.sun_path, path);
+	if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return 0;
+	/* only socket left behind by previous daemon may be replaced */
+	if(!lstat(path, &st)) {
+		if(!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "Error: `%s' exists and is not a socket.\n", path);
+			close(fd);
+			return 0;
+		}
+		if(!connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+			fprintf(stderr, "Error: Daemon already listens on `%s'.\n", path);
+			close(fd);
+			return 0;
+		}
+		unlink(path);
+	}
+	/* jobs read and write files as this user, so nobody else may connect */
+	mask = umask(077);
+	i = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if(i < 0 || listen(fd, 16) < 0) {
+		close(fd);
+		return 0;
+	}
+
+	memset(&run, 0, sizeof(run));
+	run.b = b;
+	run.client = -1;
+	pthread_mutex_init(&run.lock, NULL);
+	pthread_cond_init(&run.cond, NULL);
+	/* client going away must not kill the daemon */
+	signal(SIGPIPE, SIG_IGN);
+
+	if(threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads < 1) threads = 1;
+	if(!(workers = calloc(threads, sizeof(pthread_t))) || !(run.serving = malloc(threads * sizeof(int)))) {
+		free(workers);
+		close(fd);
+		return 0;
+	}
+	for(i = 0; i < threads; i++) run.serving[i] = -1;
+	/* signals go to accepting thread only, its accept returns on them */
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &block, &prev);
+	for(i = 0; i < threads; i++) {
+		if(pthread_create(&workers[i], NULL, batch_server_worker, &run)) break;
+	}
+	pthread_sigmask(SIG_SETMASK, &prev, NULL);
+	threads = i;
+	fprintf(stderr, "Daemon `%s' on %d threads, Ctrl+C to stop\n", path, threads);
+
+	while(threads && !*stop) {
+		int client = accept(fd, NULL, NULL);
+		if(client < 0) {
+			if(errno == EINTR || errno == ECONNABORTED) continue;
+			break;
+		}
+		pthread_mutex_lock(&run.lock);
+		/* signal handler cannot wake the wait for free worker, so check
+		 * for stop now and then */
+		while(run.client >= 0 && !*stop) {
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += BATCH_STOP_POLL * 1000000L;
+			if(ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&run.cond, &run.lock, &ts);
+		}
+		if(*stop) {
+			pthread_mutex_unlock(&run.lock);
+			close(client);
+			break;
+		}
+		run.client = client;
+		pthread_cond_broadcast(&run.cond);
+		pthread_mutex_unlock(&run.lock);
+	}
+
+	/* running jobs are finished, then their connections see end of input */
+	pthread_mutex_lock(&run.lock);
+	run.quit = 1;
+	for(i = 0; i < threads; i++) {
+		if(run.serving[i] >= 0) shutdown(run.serving[i], SHUT_RD);
+	}
+	pthread_cond_broadcast(&run.cond);
+	pthread_mutex_unlock(&run.lock);
+	for(i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+	if(run.client >= 0) close(run.client);
+	free(workers);
+	free(run.serving);
+	close(fd);
+	unlink(path);
+	fprintf(stderr, "Daemon `%s' %d jobs, %d failed\n", path, run.done, run.failed);
+
+	batch_audio_free(&run);
+	pthread_cond_destroy(&run.cond);
+	pthread_mutex_destroy(&run.lock);
+	return 1;
+}
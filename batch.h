@@ -0,0 +1,63 @@
+/*
+ * batch.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* requires throttle.h and signal.h */
+
+/* Settings shared by all jobs, manifest lines may override fps and audio. */
+typedef struct {
+	int    threads;     /* 0 for number of online CPUs */
+	int    fps;
+	int    backend;     /* FRAMES_STDIO or FRAMES_URING */
+	size_t bufSize;
+	int    writerFlags;
+	int    statsFormat; /* print per job stats when set */
+	int    every;       /* frame stride, 0 for all frames */
+	int    duration;    /* target length in seconds, 0 for no limit */
+	int    checksums;   /* store CRC32C of every chunk */
+	int    optimize;    /* re-encode frames with optimal Huffman tables */
+	int    seekmap;     /* SEEKMAP_* sidecar formats */
+	int    fastStart;   /* OpenDML indexes ahead of movie data */
+	double events;      /* activity score threshold, 0 for no events */
+	THROTTLE *readLimit;  /* optional, shared by all jobs */
+	THROTTLE *writeLimit;
+} BATCH;
+
+/* Runs every job of the manifest, one job per line:
+ *
+ *   output.avi frames.txt [fps|- [audio.mp3]]
+ *
+ * Empty lines and lines starting with # are skipped. Returns number of
+ * failed jobs, -1 when manifest cannot be read. */
+int batch_run(const BATCH *b, const char *manifest);
+/* Serves jobs sent over Unix domain socket at path until stop is set, e.g.
+ * by signal handler. Each connection sends manifest lines, list `-' is
+ * followed by frame paths or `=bytes' lines each with as many bytes of JPEG
+ * data, up to line with single dot. For each job it gets
+ * back `progress output frames total' lines while the job runs, then
+ * `done output frames bytes seconds' with `stats output {json}' or
+ * `error output message'. Soundtracks stay loaded and worker threads wait
+ * for next connection between jobs. Returns 0 when socket cannot be
+ * created. */
+int batch_serve(const BATCH *b, const char *path, volatile sig_atomic_t *stop);
@@ -0,0 +1,291 @@
+/*
+ * bench.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Generates synthetic JPEG, MP3 and ADPCM WAV inputs in temporary directory
+ * and measures mjpeg muxing throughput over growing frame counts. */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "synth.h"
+
+#define DEFAULT_WIDTH  320
+#define DEFAULT_HEIGHT 240
+#define DEFAULT_SIZE   8192
+#define DEFAULT_FILES  1000
+
+static const long default_counts[] = { 1000, 100000, 1000000 };
+
+static int write_file(const char *path, const void *data, size_t size)
+{
+	FILE *f = fopen(path, "wb");
+	if(!f) return 0;
+	if(fwrite(data, 1, size, f) != size) {
+		fclose(f);
+		return 0;
+	}
+	return fclose(f) == 0;
+}
+
+/* MPEG-1 Layer III 44.1 kHz stereo frames with random payload, VBR
+ * alternates 64, 128 and 192 kbps. */
+static int make_mp3(const char *path, int frames, int vbr)
+{
+	static const int rates[][2] = { { 0x9, 128 }, { 0xB, 192 }, { 0x5, 64 } };
+	FILE *f = fopen(path, "wb");
+	uint8_t buf[1441];
+	unsigned seed = 7;
+	int i, j;
+	if(!f) return 0;
+	for(i = 0; i < frames; i++) {
+		int r = vbr ? i % 3 : 0, pad = i % 3 == 0;
+		size_t size = 144000 * rates[r][1] / 44100 + pad;
+		uint32_t h = 0xFFFB0000 | (rates[r][0] << 12) | (pad << 9);
+		buf[0] = h >> 24, buf[1] = h >> 16, buf[2] = h >> 8, buf[3] = h;
+		for(j = 4; j < size; j++) buf[j] = (seed = seed * 1103515245 + 12345) >> 16;
+		fwrite(buf, 1, size, f);
+	}
+	return fclose(f) == 0;
+}
+
+/* Mono 22.05 kHz MS ADPCM with standard coefficient table. */
+static int make_wav(const char *path, int blocks)
+{
+	static const int16_t coefs[7][2] = { { 256, 0 }, { 512, -256 }, { 0, 0 }, { 192, 64 }, { 240, 0 }, { 460, -208 }, { 392, -232 } };
+	const uint16_t align = 512, spb = 1012;
+	uint32_t u32, fmtSize = 22 + sizeof(coefs), dataSize = (uint32_t)blocks * align;
+	uint16_t u16;
+	uint8_t block[512];
+	unsigned seed = 11;
+	FILE *f = fopen(path, "wb");
+	int i, j;
+	if(!f) return 0;
+#define W32(v) (u32 = (v), fwrite(&u32, 4, 1, f))
+#define W16(v) (u16 = (v), fwrite(&u16, 2, 1, f))
+	fwrite("RIFF", 4, 1, f); W32(4 + 8 + fmtSize + 8 + dataSize);
+	fwrite("WAVE", 4, 1, f);
+	fwrite("fmt ", 4, 1, f); W32(fmtSize);
+	W16(2); W16(1); W32(22050); W32(22050 * align / spb); W16(align); W16(4);
+	W16(4 + sizeof(coefs)); W16(spb); W16(7);
+	fwrite(coefs, sizeof(coefs), 1, f);
+	fwrite("data", 4, 1, f); W32(dataSize);
+#undef W32
+#undef W16
+	for(i = 0; i < blocks; i++) {
+		for(j = 0; j < align; j++) block[j] = (seed = seed * 1103515245 + 12345) >> 16;
+		fwrite(block, 1, align, f);
+	}
+	return fclose(f) == 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+	double   seconds;
+	uint64_t bytes;
+	uint64_t syscalls;
+	long     maxrss;
+	int      status;
+} RUN;
+
+/* Runs muxer child, collecting read/write syscall counters from
+ * /proc/<pid>/io before the zombie is reaped. */
+static int run(const char *const *args, const char *outPath, RUN *r)
+{
+	struct rusage ru;
+	struct stat st;
+	siginfo_t info;
+	char procPath[64];
+	FILE *io;
+	pid_t pid;
+	double start = now();
+
+	memset(r, 0, sizeof(*r));
+	if((pid = fork()) < 0) return 0;
+	if(pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		if(null >= 0) dup2(null, 2);
+		execv(args[0], (char *const *)args);
+		_exit(127);
+	}
+	waitid(P_PID, pid, &info, WEXITED | WNOWAIT);
+	r->seconds = now() - start;
+	snprintf(procPath, sizeof(procPath), "/proc/%d/io", (int)pid);
+	if((io = fopen(procPath, "r"))) {
+		char key[32];
+		unsigned long long value;
+		while(fscanf(io, "%31[^:]: %llu\n", key, &value) == 2) {
+			if(!strcmp(key, "syscr") || !strcmp(key, "syscw")) r->syscalls += value;
+		}
+		fclose(io);
+	}
+	wait4(pid, &r->status, 0, &ru);
+	r->maxrss = ru.ru_maxrss;
+	if(!stat(outPath, &st)) r->bytes = st.st_size;
+	return WIFEXITED(r->status) && WEXITSTATUS(r->status) == 0;
+}
+
+static void help(const char *program)
+{
+	fprintf(stderr, "Usage: %s [-m mjpeg] [-n count[,count...]] [-j files] [-z bytes] [-r WxH]\n"
+	                "          [-a none|mp3|vbr|wav] [-d dir] [-- extra mjpeg options]\n", program);
+}
+
+int main(int argc, char const *argv[])
+{
+	const char *mjpeg = "./mjpeg", *audio = "mp3", *baseDir = NULL, *extra[16];
+	long counts[16];
+	int ncounts = 0, files = DEFAULT_FILES, width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
+	int nextra = 0, argi, i, c, ret = 0;
+	size_t size = DEFAULT_SIZE, jpegSize = 0;
+	char dir[4096], path[4200], listPath[4200], outPath[4200], sndPath[4200];
+	uint8_t *jpeg;
+
+	for(argi = 1; argi < argc && *argv[argi] == '-'; argi++) {
+		if(!strcmp(argv[argi], "--")) {
+			for(argi++; argi < argc && nextra < 16; argi++) extra[nextra++] = argv[argi];
+			break;
+		} else if(!strcmp(argv[argi], "-m") && argi + 1 < argc) {
+			mjpeg = argv[++argi];
+		} else if(!strcmp(argv[argi], "-n") && argi + 1 < argc) {
+			char *p = (char *)argv[++argi];
+			while(*p && ncounts < 16) {
+				counts[ncounts++] = strtol(p, &p, 10);
+				if(*p == ',') p++;
+			}
+		} else if(!strcmp(argv[argi], "-j") && argi + 1 < argc) {
+			files = atoi(argv[++argi]);
+		} else if(!strcmp(argv[argi], "-z") && argi + 1 < argc) {
+			size = strtoul(argv[++argi], NULL, 10);
+		} else if(!strcmp(argv[argi], "-r") && argi + 1 < argc) {
+			if(sscanf(argv[++argi], "%dx%d", &width, &height) != 2) width = 0;
+		} else if(!strcmp(argv[argi], "-a") && argi + 1 < argc) {
+			audio = argv[++argi];
+		} else if(!strcmp(argv[argi], "-d") && argi + 1 < argc) {
+			baseDir = argv[++argi];
+		} else {
+			help(argv[0]);
+			return 255;
+		}
+	}
+	if(ncounts == 0) {
+		memcpy(counts, default_counts, sizeof(default_counts));
+		ncounts = sizeof(default_counts) / sizeof(*default_counts);
+	}
+	if(files <= 0 || width <= 0 || height <= 0 || width > 65535 || height > 65535) {
+		help(argv[0]);
+		return 255;
+	}
+
+	snprintf(dir, sizeof(dir), "%s/mjpeg-bench.XXXXXX", baseDir ?: (getenv("TMPDIR") ?: "/tmp"));
+	if(!mkdtemp(dir)) {
+		fprintf(stderr, "Error: Cannot create temporary directory `%s'.\n", dir);
+		return 1;
+	}
+
+	if(!(jpeg = malloc(synth_jpeg_max(width, height)))) return 1;
+	for(i = 0; i < files; i++) {
+		jpegSize = synth_jpeg(jpeg, width, height, size, i + 1, NULL, 0);
+		snprintf(path, sizeof(path), "%s/%06d.jpg", dir, i);
+		if(!write_file(path, jpeg, jpegSize)) {
+			fprintf(stderr, "Error: Cannot write `%s'.\n", path);
+			ret = 2;
+			goto cleanup;
+		}
+	}
+	free(jpeg), jpeg = NULL;
+
+	*sndPath = 0;
+	if(!strcmp(audio, "mp3") || !strcmp(audio, "vbr")) {
+		snprintf(sndPath, sizeof(sndPath), "%s/audio.mp3", dir);
+		make_mp3(sndPath, 3000, !strcmp(audio, "vbr"));
+	} else if(!strcmp(audio, "wav")) {
+		snprintf(sndPath, sizeof(sndPath), "%s/audio.wav", dir);
+		make_wav(sndPath, 2000);
+	}
+
+	fprintf(stderr, "Bench `%s' %dx%d, %d files of ~%zu bytes, audio: %s\n", dir, width, height, files, jpegSize, audio);
+	printf("%10s %10s %12s %10s %12s %10s\n", "frames", "seconds", "frames/s", "MB/s", "syscalls", "maxrss KB");
+	for(c = 0; c < ncounts; c++) {
+		const char *args[48];
+		int nargs = 0;
+		FILE *list;
+		RUN r;
+		long n;
+
+		snprintf(listPath, sizeof(listPath), "%s/frames.txt", dir);
+		snprintf(outPath, sizeof(outPath), "%s/out.avi", dir);
+		if(!(list = fopen(listPath, "w"))) {
+			ret = 2;
+			break;
+		}
+		/* frames cycle over generated files, keeping inode count bounded */
+		for(n = 0; n < counts[c]; n++) fprintf(list, "%s/%06ld.jpg\n", dir, n % files);
+		fclose(list);
+
+		args[nargs++] = mjpeg;
+		for(i = 0; i < nextra; i++) args[nargs++] = extra[i];
+		args[nargs++] = "-o", args[nargs++] = outPath;
+		if(*sndPath) args[nargs++] = "-s", args[nargs++] = sndPath;
+		args[nargs++] = "-l", args[nargs++] = listPath;
+		args[nargs] = NULL;
+
+		if(!run(args, outPath, &r)) {
+			fprintf(stderr, "Error: `%s' failed for %ld frames, status %d.\n", mjpeg, counts[c], r.status);
+			ret = 3;
+		}
+		printf("%10ld %10.3f %12.0f %10.1f %12llu %10ld\n", counts[c], r.seconds,
+			counts[c] / r.seconds, r.bytes / r.seconds / (1024.0 * 1024.0),
+			(unsigned long long)r.syscalls, r.maxrss);
+		fflush(stdout);
+		unlink(outPath);
+		unlink(listPath);
+	}
+
+cleanup:
+	free(jpeg);
+	for(i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/%06d.jpg", dir, i);
+		unlink(path);
+	}
+	if(*sndPath) unlink(sndPath);
+	rmdir(dir);
+	return ret;
+}
@@ -0,0 +1,123 @@
+/*
+ * synth.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "synth.h"
+
+/* Bit writer with JPEG 0xFF byte stuffing. */
+typedef struct {
+	uint8_t *buf;
+	size_t   len;
+	uint32_t acc;
+	int      bits;
+} BITS;
+
+static void bits_put(BITS *b, uint32_t value, int count)
+{
+	while(count-- > 0) {
+		b->acc = (b->acc << 1) | ((value >> count) & 1);
+		if(++b->bits == 8) {
+			b->buf[b->len++] = (uint8_t)b->acc;
+			if((uint8_t)b->acc == 0xFF) b->buf[b->len++] = 0;
+			b->acc = 0;
+			b->bits = 0;
+		}
+	}
+}
+
+static void bits_flush(BITS *b)
+{
+	while(b->bits) bits_put(b, 1, 1);
+}
+
+static size_t put_segment(uint8_t *p, uint16_t marker, const uint8_t *data, uint16_t size)
+{
+	p[0] = marker >> 8;
+	p[1] = marker & 0xFF;
+	p[2] = (size + 2) >> 8;
+	p[3] = (size + 2) & 0xFF;
+	memcpy(p + 4, data, size);
+	return size + 4;
+}
+
+/* Every block carries zero DC difference and a number of run 0, size 10
+ * AC coefficients with random bits, chosen so that the file lands close to
+ * requested size. Huffman tables are trivial: DC has single code `0', AC has
+ * `00' EOB and `01' for run 0, size 10. */
+size_t synth_jpeg(uint8_t *out, int width, int height, size_t target, unsigned seed,
+                  const uint8_t *dc, uint16_t dcSize)
+{
+	static const uint8_t dht_dc[] = { 0x00, 1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0x00 };
+	static const uint8_t dht_ac[] = { 0x10, 0,2,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0x00, 0x0A };
+	uint8_t seg[64 + 1], sof[9] = { 8, height >> 8, height & 0xFF, width >> 8, width & 0xFF, 1, 1, 0x11, 0 };
+	static const uint8_t sos[] = { 1, 1, 0x00, 0, 63, 0 };
+	int blocks = ((width + 7) / 8) * ((height + 7) / 8), i, k, perBlock;
+	size_t len = 0, header;
+	BITS b;
+
+	out[len++] = 0xFF, out[len++] = 0xD8;
+	seg[0] = 0;
+	for(i = 1; i <= 64; i++) seg[i] = 1;
+	len += put_segment(out + len, 0xFFDB, seg, 65);
+	len += put_segment(out + len, 0xFFC0, sof, sizeof(sof));
+	len += dc ? put_segment(out + len, 0xFFC4, dc, dcSize) : put_segment(out + len, 0xFFC4, dht_dc, sizeof(dht_dc));
+	len += put_segment(out + len, 0xFFC4, dht_ac, sizeof(dht_ac));
+	len += put_segment(out + len, 0xFFDA, sos, sizeof(sos));
+	header = len + 2;
+
+	/* DC code is 1 bit, each AC coefficient 12 bits, EOB 2 bits */
+	perBlock = target > header ? (int)(((target - header) * 8 / blocks - 3) / 12) : 0;
+	if(perBlock < 0) perBlock = 0;
+	if(perBlock > 63) perBlock = 63;
+
+	b.buf = out + len;
+	b.len = 0;
+	b.acc = 0;
+	b.bits = 0;
+	for(i = 0; i < blocks; i++) {
+		bits_put(&b, 0, 1);
+		for(k = 0; k < perBlock; k++) {
+			seed = seed * 1103515245 + 12345;
+			bits_put(&b, 1, 2);
+			bits_put(&b, (seed >> 16) & 0x3FF, 10);
+		}
+		if(perBlock < 63) bits_put(&b, 0, 2);
+	}
+	bits_flush(&b);
+	len += b.len;
+	out[len++] = 0xFF, out[len++] = 0xD9;
+	return len;
+}
+
+size_t synth_jpeg_max(int width, int height)
+{
+	/* worst case is 63 coefficients of 12 bits per block, fully stuffed,
+	 * headers with largest possible DC table */
+	return 1024 + 256 + (size_t)((width + 7) / 8) * ((height + 7) / 8) * 192;
+}
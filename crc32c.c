@@ -0,0 +1,103 @@
+/*
+ * crc32c.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82F63B78 /* reversed 0x1EDC6F41 */
+
+static uint32_t crc32c_table[8][256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static uint32_t (*crc32c_impl)(uint32_t crc, const uint8_t *p, size_t len);
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+	/* byte at a time until aligned, then 8 bytes per step */
+	while(len && ((uintptr_t)p & 7)) {
+		crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+		len--;
+	}
+	while(len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		v ^= crc;
+		crc = crc32c_table[7][v & 0xFF] ^ crc32c_table[6][(v >> 8) & 0xFF] ^
+		      crc32c_table[5][(v >> 16) & 0xFF] ^ crc32c_table[4][(v >> 24) & 0xFF] ^
+		      crc32c_table[3][(v >> 32) & 0xFF] ^ crc32c_table[2][(v >> 40) & 0xFF] ^
+		      crc32c_table[1][(v >> 48) & 0xFF] ^ crc32c_table[0][v >> 56];
+		p += 8, len -= 8;
+	}
+	while(len--) crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+	uint64_t crc64 = crc;
+	while(len && ((uintptr_t)p & 7)) {
+		crc64 = __builtin_ia32_crc32qi(crc64, *p++);
+		len--;
+	}
+	while(len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc64 = __builtin_ia32_crc32di(crc64, v);
+		p += 8, len -= 8;
+	}
+	while(len--) crc64 = __builtin_ia32_crc32qi(crc64, *p++);
+	return crc64;
+}
+#endif
+
+static void crc32c_init(void)
+{
+	uint32_t i, j, crc;
+	for(i = 0; i < 256; i++) {
+		crc = i;
+		for(j = 0; j < 8; j++) crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+		crc32c_table[0][i] = crc;
+	}
+	for(i = 0; i < 256; i++) {
+		for(j = 1; j < 8; j++) {
+			crc32c_table[j][i] = crc32c_table[0][crc32c_table[j - 1][i] & 0xFF] ^ (crc32c_table[j - 1][i] >> 8);
+		}
+	}
+	crc32c_impl = crc32c_sw;
+#if defined(__x86_64__) && defined(__GNUC__)
+	if(__builtin_cpu_supports("sse4.2")) crc32c_impl = crc32c_hw;
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+	pthread_once(&crc32c_once, crc32c_init);
+	return ~crc32c_impl(~crc, data, len);
+}
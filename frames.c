@@ -0,0 +1,710 @@
+/*
+ * frames.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "jpeg.h"
+#include "throttle.h"
+#include "frames.h"
+
+#ifdef HAVE_IO_URING
+
+#define SLOT_FREE    0
+#define SLOT_OPENING 1
+#define SLOT_READING 2
+#define SLOT_DONE    3
+
+#define OP_OPEN  0
+#define OP_READ  1
+#define OP_CLOSE 2
+
+#define USERDATA(slot, op) (((uint64_t)(op) << 32) | (uint32_t)(slot))
+
+typedef struct {
+	int      state;
+	int      fd;
+	int      failed;
+	uint8_t *buf;
+	size_t   size;
+} SLOT;
+
+typedef struct {
+	int       fd;
+	int       fixed;    /* buffers registered with the ring */
+	int       draining; /* reader is closing, do not start new reads */
+	unsigned  pending;  /* prepared but not yet submitted SQEs */
+	unsigned  inflight; /* submitted SQEs without completion yet */
+	unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void    *sqPtr, *cqPtr;
+	size_t   sqSize, cqSize, sqesSize;
+	SLOT     slots[FRAMES_DEPTH];
+	uint8_t *pool;
+} URING;
+#endif
+
+#define OPT_FREE   0
+#define OPT_QUEUED 1
+#define OPT_DONE   2
+
+typedef struct {
+	int      state;
+	int      missing;  /* frame could not be read */
+	uint8_t *in, *out;
+	size_t   inSize, inCap, outSize, outCap;
+} OPT_JOB;
+
+/* Frames read ahead and re-encoded by worker threads, returned in order. */
+typedef struct {
+	pthread_t      *threads;
+	int             count;    /* 0 re-encodes in caller thread */
+	int             depth;
+	OPT_JOB        *jobs;
+	pthread_mutex_t lock;
+	pthread_cond_t  work, done;
+	int             queued;   /* frames handed over to workers */
+	int             taken;    /* frames taken by workers */
+	int             returned; /* frames returned to the caller */
+	int             quit;
+	uint64_t        inBytes, outBytes;
+} OPTIMIZER;
+
+struct FRAMES {
+	const char *const *paths;
+	int      count;
+	int      next;   /* next frame returned to the caller */
+	int      backend;
+	uint8_t *buf;    /* stdio backend and oversized frames */
+	size_t   bufSize;
+	OPTIMIZER *opt;
+	THROTTLE *throttle; /* optional read rate limit */
+#ifdef HAVE_IO_URING
+	int      queued; /* next frame submitted to the ring */
+	URING    ring;
+#endif
+};
+
+/* stdio backend */
+
+static int frames_read_stdio(FRAMES *f, const char *path, const void **data, size_t *size)
+{
+	FILE *in = fopen(path, "rb");
+	long len;
+	*data = NULL;
+	*size = 0;
+	if(!in) return 1;
+	if(fseek(in, 0, SEEK_END) || (len = ftell(in)) < 0) {
+		fclose(in);
+		return 1;
+	}
+	fseek(in, 0, SEEK_SET);
+	if(len + 1 > f->bufSize) {
+		uint8_t *buf = realloc(f->buf, len + 1);
+		if(!buf) {
+			fclose(in);
+			return 1;
+		}
+		f->buf = buf;
+		f->bufSize = len + 1;
+	}
+	while(*size < (size_t)len) {
+		size_t chunk = throttle_chunk(f->throttle, len - *size), got;
+		throttle_take(f->throttle, chunk);
+		*size += got = fread(f->buf + *size, 1, chunk, in);
+		if(got < chunk) break;
+	}
+	*data = f->buf;
+	fclose(in);
+	return 1;
+}
+
+/* io_uring backend */
+
+#ifdef HAVE_IO_URING
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned op, void *arg, unsigned nargs)
+{
+	return (int)syscall(__NR_io_uring_register, fd, op, arg, nargs);
+}
+
+static void uring_close(URING *r)
+{
+	if(r->sqes) munmap(r->sqes, r->sqesSize);
+	if(r->cqPtr && r->cqPtr != r->sqPtr) munmap(r->cqPtr, r->cqSize);
+	if(r->sqPtr) munmap(r->sqPtr, r->sqSize);
+	if(r->fd >= 0) close(r->fd);
+	free(r->pool);
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+}
+
+static int uring_supports(int fd, const uint8_t *ops, int count)
+{
+	size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, len);
+	int i, ret = 1;
+	if(!probe) return 0;
+	if(uring_register(fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+		ret = 0;
+	} else {
+		for(i = 0; i < count; i++) {
+			if(ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) ret = 0;
+		}
+	}
+	free(probe);
+	return ret;
+}
+
+static int uring_open(URING *r)
+{
+	static const uint8_t ops[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE };
+	struct io_uring_params p;
+	struct iovec iov[FRAMES_DEPTH];
+	int i;
+
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+	/* each slot needs at most open, read and close in flight */
+	if((r->fd = uring_setup(FRAMES_DEPTH * 4, &p)) < 0) return 0;
+	if(!uring_supports(r->fd, ops, sizeof(ops))) goto fail;
+
+	r->sqSize   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cqSize   = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		if(r->cqSize > r->sqSize) r->sqSize = r->cqSize;
+		r->cqSize = r->sqSize;
+	}
+	r->sqPtr = mmap(NULL, r->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if(r->sqPtr == MAP_FAILED) { r->sqPtr = NULL; goto fail; }
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cqPtr = r->sqPtr;
+	} else {
+		r->cqPtr = mmap(NULL, r->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if(r->cqPtr == MAP_FAILED) { r->cqPtr = NULL; goto fail; }
+	}
+	r->sqes = mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if(r->sqes == MAP_FAILED) { r->sqes = NULL; goto fail; }
+
+	r->sqHead  = (unsigned *)((uint8_t *)r->sqPtr + p.sq_off.head);
+	r->sqTail  = (unsigned *)((uint8_t *)r->sqPtr + p.sq_off.tail);
+	r->sqMask  = (unsigned *)((uint8_t *)r->sqPtr + p.sq_off.ring_mask);
+	r->sqArray = (unsigned *)((uint8_t *)r->sqPtr + p.sq_off.array);
+	r->cqHead  = (unsigned *)((uint8_t *)r->cqPtr + p.cq_off.head);
+	r->cqTail  = (unsigned *)((uint8_t *)r->cqPtr + p.cq_off.tail);
+	r->cqMask  = (unsigned *)((uint8_t *)r->cqPtr + p.cq_off.ring_mask);
+	r->cqes    = (struct io_uring_cqe *)((uint8_t *)r->cqPtr + p.cq_off.cqes);
+
+	/* one page aligned pool carved into per slot buffers */
+	if(posix_memalign((void **)&r->pool, 4096, (size_t)FRAMES_DEPTH * FRAMES_BUFSIZE)) {
+		r->pool = NULL;
+		goto fail;
+	}
+	for(i = 0; i < FRAMES_DEPTH; i++) {
+		r->slots[i].buf = r->pool + (size_t)i * FRAMES_BUFSIZE;
+		iov[i].iov_base = r->slots[i].buf;
+		iov[i].iov_len  = FRAMES_BUFSIZE;
+	}
+	/* registration may fail on low RLIMIT_MEMLOCK, plain reads still work */
+	r->fixed = uring_register(r->fd, IORING_REGISTER_BUFFERS, iov, FRAMES_DEPTH) == 0;
+	return 1;
+
+fail:
+	uring_close(r);
+	return 0;
+}
+
+static int uring_submit(URING *r, unsigned wait);
+
+static struct io_uring_sqe *uring_sqe(URING *r)
+{
+	unsigned tail = *r->sqTail + r->pending;
+	struct io_uring_sqe *sqe;
+	if(tail - __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE) > *r->sqMask) {
+		uring_submit(r, 0);
+		tail = *r->sqTail;
+	}
+	sqe = &r->sqes[tail & *r->sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	r->sqArray[tail & *r->sqMask] = tail & *r->sqMask;
+	r->pending++;
+	return sqe;
+}
+
+static void uring_prep_open(URING *r, int slot, const char *path)
+{
+	struct io_uring_sqe *sqe = uring_sqe(r);
+	sqe->opcode     = IORING_OP_OPENAT;
+	sqe->fd         = AT_FDCWD;
+	sqe->addr       = (uintptr_t)path;
+	sqe->open_flags = O_RDONLY;
+	sqe->user_data  = USERDATA(slot, OP_OPEN);
+	r->slots[slot].state  = SLOT_OPENING;
+	r->slots[slot].failed = 0;
+	r->slots[slot].size   = 0;
+}
+
+static void uring_prep_read(URING *r, int slot)
+{
+	struct io_uring_sqe *sqe = uring_sqe(r);
+	SLOT *s = &r->slots[slot];
+	sqe->opcode    = r->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd        = s->fd;
+	sqe->addr      = (uintptr_t)s->buf;
+	sqe->len       = FRAMES_BUFSIZE;
+	sqe->buf_index = r->fixed ? slot : 0;
+	/* close must run even when read fails */
+	sqe->flags     = IOSQE_IO_HARDLINK;
+	sqe->user_data = USERDATA(slot, OP_READ);
+	sqe = uring_sqe(r);
+	sqe->opcode    = IORING_OP_CLOSE;
+	sqe->fd        = s->fd;
+	sqe->user_data = USERDATA(slot, OP_CLOSE);
+	s->state = SLOT_READING;
+}
+
+static int uring_submit(URING *r, unsigned wait)
+{
+	unsigned submit = r->pending;
+	int ret;
+	__atomic_store_n(r->sqTail, *r->sqTail + r->pending, __ATOMIC_RELEASE);
+	r->pending = 0;
+	do {
+		ret = uring_enter(r->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+	} while(ret < 0 && errno == EINTR);
+	if(ret > 0) r->inflight += ret;
+	return ret;
+}
+
+static void uring_reap(URING *r)
+{
+	unsigned head = *r->cqHead;
+	while(head != __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe *cqe = &r->cqes[head & *r->cqMask];
+		int slot = (int)(uint32_t)cqe->user_data;
+		SLOT *s = &r->slots[slot];
+		switch(cqe->user_data >> 32) {
+		case OP_OPEN:
+			if(cqe->res < 0) {
+				s->failed = 1;
+				s->state = SLOT_DONE;
+			} else if(r->draining) {
+				close(cqe->res);
+				s->state = SLOT_DONE;
+			} else {
+				s->fd = cqe->res;
+				uring_prep_read(r, slot);
+			}
+			break;
+		case OP_READ:
+			if(cqe->res < 0) {
+				s->failed = 1;
+			} else {
+				s->size = cqe->res;
+			}
+			s->state = SLOT_DONE;
+			break;
+		}
+		r->inflight--;
+		head++;
+	}
+	__atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+}
+
+static int frames_next_uring(FRAMES *f, const void **data, size_t *size)
+{
+	URING *r = &f->ring;
+	int slot = f->next % FRAMES_DEPTH;
+	SLOT *s = &r->slots[slot];
+
+	/* previous frame was consumed, so its slot is free */
+	if(f->next > 0) r->slots[(f->next - 1) % FRAMES_DEPTH].state = SLOT_FREE;
+	while(f->queued < f->count && f->queued < f->next + FRAMES_DEPTH &&
+	      r->slots[f->queued % FRAMES_DEPTH].state == SLOT_FREE) {
+		uring_prep_open(r, f->queued % FRAMES_DEPTH, f->paths[f->queued]);
+		f->queued++;
+	}
+	while(s->state != SLOT_DONE) {
+		if(uring_submit(r, 1) < 0) {
+			/* ring is broken, finish remaining frames synchronously */
+			f->backend = FRAMES_STDIO;
+			return frames_read_stdio(f, f->paths[f->next++], data, size);
+		}
+		uring_reap(r);
+	}
+	if(r->pending) uring_submit(r, 0);
+
+	if(s->failed) {
+		*data = NULL;
+		*size = 0;
+	} else if(s->size == FRAMES_BUFSIZE) {
+		/* frame may be larger than slot buffer, reread it as a whole */
+		frames_read_stdio(f, f->paths[f->next], data, size);
+	} else {
+		/* ring reads are paid after completion, the debt holds back next
+		 * submissions */
+		throttle_take(f->throttle, s->size);
+		*data = s->buf;
+		*size = s->size;
+	}
+	f->next++;
+	return 1;
+}
+#endif
+
+/* Reads frame list, one path per line, appending to paths array. */
+int frames_list(const char *path, const char ***paths, int *count)
+{
+	FILE *in = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	int alloc = *count;
+	if(!in) return 0;
+	while((len = getline(&line, &cap, in)) >= 0) {
+		while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = 0;
+		if(len == 0) continue;
+		if(*count >= alloc) {
+			const char **grown = realloc(*paths, (alloc = alloc ? alloc * 2 : 1024) * sizeof(char *));
+			if(!grown) break;
+			*paths = grown;
+		}
+		(*paths)[(*count)++] = strdup(line);
+	}
+	free(line);
+	if(in != stdin) fclose(in);
+	return 1;
+}
+
+int frames_select(const char **paths, int count, int every, int total)
+{
+	int i, n = 0;
+	if(every > 1) {
+		for(i = 0; i < count; i += every) paths[n++] = paths[i];
+		count = n, n = 0;
+	}
+	if(total > 0 && count > total) {
+		/* evenly spread, first frame always kept */
+		for(i = 0; i < total; i++) paths[n++] = paths[(int64_t)i * count / total];
+		count = n;
+	}
+	return count;
+}
+
+int frames_times(const char **paths, int count, int source, double *times)
+{
+	struct stat st;
+	int i;
+	for(i = 0; i < count; i++) {
+		if(source == FRAMES_TIME_LIST) {
+			/* path<TAB>seconds, path is replaced by its copy up to the tab */
+			const char *tab = strrchr(paths[i], '\t');
+			char *end, *path;
+			if(!tab) return i;
+			times[i] = strtod(tab + 1, &end);
+			if(end == tab + 1 || !(path = strndup(paths[i], tab - paths[i]))) return i;
+			paths[i] = path;
+		} else if(source == FRAMES_TIME_EXIF) {
+			if(!jpeg_time(paths[i], &times[i])) return i;
+		} else {
+			if(stat(paths[i], &st)) return i;
+			times[i] = st.st_mtim.tv_sec + st.st_mtim.tv_nsec / 1e9;
+		}
+	}
+	return count;
+}
+
+typedef struct {
+	double      time;
+	const char *path;
+	int         index;
+} FRAME_TIME;
+
+static int frame_time_cmp(const void *a, const void *b)
+{
+	const FRAME_TIME *x = a, *y = b;
+	if(x->time != y->time) return x->time < y->time ? -1 : 1;
+	return x->index - y->index;
+}
+
+int frames_sort(const char **paths, double *times, int count)
+{
+	FRAME_TIME *sorted;
+	int i, moved = 0;
+	for(i = 1; i < count && times[i] >= times[i - 1]; i++);
+	if(i >= count) return 0;
+	if(!(sorted = malloc(count * sizeof(FRAME_TIME)))) return -1;
+	for(i = 0; i < count; i++) {
+		sorted[i].time = times[i];
+		sorted[i].path = paths[i];
+		sorted[i].index = i;
+	}
+	/* stable, frames of equal time keep list order */
+	qsort(sorted, count, sizeof(FRAME_TIME), frame_time_cmp);
+	for(i = 0; i < count; i++) {
+		moved += sorted[i].index != i;
+		times[i] = sorted[i].time;
+		paths[i] = sorted[i].path;
+	}
+	free(sorted);
+	return moved;
+}
+
+int frames_slots(const char **paths, const double *times, int count, int fps, int *repeats)
+{
+	int64_t last = -1, slot;
+	int i, n = 0;
+	for(i = 0; i < count; i++) {
+		slot = (int64_t)((times[i] - times[0]) * fps + 0.5);
+		/* frames of already filled slot are dropped */
+		if(slot <= last) continue;
+		repeats[n] = slot - last - 1;
+		paths[n++] = paths[i];
+		last = slot;
+	}
+	return n;
+}
+
+FRAMES *frames_open(const char *const *paths, int count, int backend)
+{
+	FRAMES *f = calloc(1, sizeof(FRAMES));
+	if(!f) return NULL;
+	f->paths = paths;
+	f->count = count;
+	f->backend = FRAMES_STDIO;
+#ifdef HAVE_IO_URING
+	if(backend == FRAMES_URING && uring_open(&f->ring)) {
+		f->backend = FRAMES_URING;
+	}
+#endif
+	return f;
+}
+
+static int frames_read(FRAMES *f, const void **data, size_t *size)
+{
+	if(f->next >= f->count) return 0;
+#ifdef HAVE_IO_URING
+	if(f->backend == FRAMES_URING) return frames_next_uring(f, data, size);
+#endif
+	return frames_read_stdio(f, f->paths[f->next++], data, size);
+}
+
+static void frames_reencode(OPT_JOB *job)
+{
+	job->outSize = job->missing ? 0 : jpeg_optimize(job->in, job->inSize, &job->out, &job->outCap);
+}
+
+static void *frames_worker(void *arg)
+{
+	OPTIMIZER *o = arg;
+	pthread_mutex_lock(&o->lock);
+	for(;;) {
+		OPT_JOB *job;
+		while(o->taken == o->queued && !o->quit) pthread_cond_wait(&o->work, &o->lock);
+		if(o->taken == o->queued) break;
+		job = &o->jobs[o->taken++ % o->depth];
+		pthread_mutex_unlock(&o->lock);
+		frames_reencode(job);
+		pthread_mutex_lock(&o->lock);
+		job->state = OPT_DONE;
+		pthread_cond_broadcast(&o->done);
+	}
+	pthread_mutex_unlock(&o->lock);
+	return NULL;
+}
+
+static int frames_next_optimized(FRAMES *f, const void **data, size_t *size)
+{
+	OPTIMIZER *o = f->opt;
+	OPT_JOB *job;
+	const void *in;
+	size_t len;
+
+	if(o->returned >= f->count) return 0;
+	/* read ahead, job of frame returned by previous call is free again */
+	while(f->next < f->count && f->next < o->returned + o->depth) {
+		job = &o->jobs[f->next % o->depth];
+		frames_read(f, &in, &len);
+		job->missing = !in;
+		job->inSize = in ? len : 0;
+		if(job->inSize > job->inCap) {
+			uint8_t *grown = realloc(job->in, job->inSize);
+			if(!grown) {
+				job->missing = 1;
+				job->inSize = 0;
+			} else {
+				job->in = grown;
+				job->inCap = job->inSize;
+			}
+		}
+		if(job->inSize) memcpy(job->in, in, job->inSize);
+		if(!o->count) {
+			frames_reencode(job);
+			job->state = OPT_DONE;
+			continue;
+		}
+		pthread_mutex_lock(&o->lock);
+		job->state = OPT_QUEUED;
+		o->queued++;
+		pthread_cond_signal(&o->work);
+		pthread_mutex_unlock(&o->lock);
+	}
+
+	job = &o->jobs[o->returned++ % o->depth];
+	if(o->count) {
+		pthread_mutex_lock(&o->lock);
+		while(job->state != OPT_DONE) pthread_cond_wait(&o->done, &o->lock);
+		pthread_mutex_unlock(&o->lock);
+	}
+	job->state = OPT_FREE;
+	if(job->missing) {
+		*data = NULL;
+		*size = 0;
+		return 1;
+	}
+	/* frames that cannot be made smaller are passed as they are */
+	*data = job->outSize ? job->out : job->in;
+	*size = job->outSize ? job->outSize : job->inSize;
+	o->inBytes += job->inSize;
+	o->outBytes += *size;
+	return 1;
+}
+
+int frames_next(FRAMES *f, const void **data, size_t *size)
+{
+	if(!f) return 0;
+	if(f->opt) return frames_next_optimized(f, data, size);
+	return frames_read(f, data, size);
+}
+
+int frames_optimize(FRAMES *f, int threads)
+{
+	OPTIMIZER *o;
+	if(!f || f->opt || f->next) return 0;
+	if(!(o = calloc(1, sizeof(OPTIMIZER)))) return 0;
+	/* single frame (watch mode) is not worth starting threads */
+	if(f->count < 2) threads = 0;
+	else if(threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+	o->depth = threads ? threads * 2 : 1;
+	if(!(o->jobs = calloc(o->depth, sizeof(OPT_JOB))) ||
+	   (threads && !(o->threads = calloc(threads, sizeof(pthread_t))))) {
+		free(o->jobs);
+		free(o);
+		return 0;
+	}
+	pthread_mutex_init(&o->lock, NULL);
+	pthread_cond_init(&o->work, NULL);
+	pthread_cond_init(&o->done, NULL);
+	while(o->count < threads && !pthread_create(&o->threads[o->count], NULL, frames_worker, o)) o->count++;
+	if(!o->count) o->depth = 1;
+	f->opt = o;
+	return 1;
+}
+
+void frames_throttle(FRAMES *f, THROTTLE *t)
+{
+	f->throttle = t;
+}
+
+void frames_savings(FRAMES *f, uint64_t *in, uint64_t *out)
+{
+	*in = f && f->opt ? f->opt->inBytes : 0;
+	*out = f && f->opt ? f->opt->outBytes : 0;
+}
+
+int frames_backend(FRAMES *f)
+{
+	return f ? f->backend : FRAMES_STDIO;
+}
+
+void frames_close(FRAMES *f)
+{
+	if(!f) return;
+	if(f->opt) {
+		OPTIMIZER *o = f->opt;
+		int i;
+		pthread_mutex_lock(&o->lock);
+		o->quit = 1;
+		pthread_cond_broadcast(&o->work);
+		pthread_mutex_unlock(&o->lock);
+		for(i = 0; i < o->count; i++) pthread_join(o->threads[i], NULL);
+		for(i = 0; i < o->depth; i++) {
+			free(o->jobs[i].in);
+			free(o->jobs[i].out);
+		}
+		pthread_mutex_destroy(&o->lock);
+		pthread_cond_destroy(&o->work);
+		pthread_cond_destroy(&o->done);
+		free(o->threads);
+		free(o->jobs);
+		free(o);
+	}
+#ifdef HAVE_IO_URING
+	if(f->ring.sqPtr) {
+		/* wait for in-flight reads before their buffers go away */
+		f->ring.draining = 1;
+		if(f->ring.pending) uring_submit(&f->ring, 0);
+		while(f->ring.inflight && uring_submit(&f->ring, 1) >= 0) {
+			uring_reap(&f->ring);
+		}
+		uring_close(&f->ring);
+	}
+#endif
+	free(f->buf);
+	free(f);
+}
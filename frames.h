@@ -0,0 +1,72 @@
+/*
+ * frames.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define FRAMES_STDIO 0
+#define FRAMES_URING 1
+
+#define FRAMES_DEPTH   32          /* frames in flight for io_uring */
+#define FRAMES_BUFSIZE (1024*1024) /* per frame registered buffer */
+
+#define FRAMES_TIME_MTIME 0 /* file modification time */
+#define FRAMES_TIME_EXIF  1 /* EXIF DateTimeOriginal */
+#define FRAMES_TIME_LIST  2 /* seconds after tab in frame list line */
+
+typedef struct FRAMES FRAMES;
+
+/* Reads frame list, one path per line ("-" for standard input), appending
+ * to paths array. Returns 0 when list cannot be opened. */
+int frames_list(const char *path, const char ***paths, int *count);
+/* Keeps every Nth path, then evenly picks total paths if there are more
+ * (0 for no limit). Works in place, returns new count. */
+int frames_select(const char **paths, int count, int every, int total);
+/* Reads capture time of each frame in seconds. With FRAMES_TIME_LIST paths
+ * are replaced by their copies cut off at the tab. Returns number of frames
+ * with known time, count on success. */
+int frames_times(const char **paths, int count, int source, double *times);
+/* Orders frames by time, keeping list order of equal times. Returns number
+ * of frames that moved, -1 when out of memory. */
+int frames_sort(const char **paths, double *times, int count);
+/* Maps frame times in order (see frames_sort) onto slots of fixed frame
+ * rate, keeping first frame of each slot and counting empty slots before it
+ * in repeats. Works in place, returns new count. */
+int frames_slots(const char **paths, const double *times, int count, int fps, int *repeats);
+/* Opens reader over list of frame paths, backend FRAMES_URING falls back to
+ * FRAMES_STDIO when io_uring is not compiled in or not usable at runtime. */
+FRAMES *frames_open(const char *const *paths, int count, int backend);
+/* Returns 1 with whole frame contents, 1 with NULL data when frame cannot be
+ * read, 0 when list is exhausted. Data is valid until next call. */
+int frames_next(FRAMES *f, const void **data, size_t *size);
+/* Re-encodes frames with optimal Huffman tables (jpeg_optimize) on given
+ * number of threads (0 for number of online CPUs), reading ahead of the
+ * caller. Frames come out in order, those which cannot be made smaller as
+ * they are. Call before first frames_next, returns 0 when not possible. */
+int frames_optimize(FRAMES *f, int threads);
+/* Limits read rate with given token bucket, stdio reads are split into
+ * chunks sized by throttle_chunk. Requires throttle.h. */
+void frames_throttle(FRAMES *f, THROTTLE *t);
+/* Bytes of optimized frames so far before and after re-encoding. */
+void frames_savings(FRAMES *f, uint64_t *in, uint64_t *out);
+int frames_backend(FRAMES *f);
+void frames_close(FRAMES *f);
@@ -25,6 +25,9 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <arpa/inet.h>
 
 #define JPEG_MARKER_MASK 0xFF00
@@ -49,13 +52,11 @@ typedef struct {
 	uint16_t width;
 } __attribute__((packed)) JPEG_SIZE;
 
-int jpeg_size(const char *path, int *width, int *height)
+static int jpeg_size_stream(FILE *in, int *width, int *height)
 {
 	JPEG_CHUNK chunk;
 	JPEG_SIZE size;
 	int ret = 0, i;
-	FILE *in = fopen(path, "rb");
-	if(!in) return 0;
 
 	if(fread(&chunk.marker, 1, sizeof(chunk.marker), in) == sizeof(chunk.marker)) {
 		chunk.marker = ntohs(chunk.marker);
@@ -81,6 +82,600 @@ int jpeg_size(const char *path, int *width, int *height)
 		}
 	}
 
+	return ret;
+}
+
+int jpeg_size(const char *path, int *width, int *height)
+{
+	FILE *in = fopen(path, "rb");
+	int ret;
+	if(!in) return 0;
+	ret = jpeg_size_stream(in, width, height);
+	fclose(in);
+	return ret;
+}
+
+int jpeg_size_data(const void *data, size_t len, int *width, int *height)
+{
+	FILE *in = fmemopen((void *)data, len, "rb");
+	int ret;
+	if(!in) return 0;
+	ret = jpeg_size_stream(in, width, height);
 	fclose(in);
 	return ret;
 }
+
+#define JPEG_APP1_MARKER 0xFFE1
+#define JPEG_SOS_MARKER  0xFFDA
+
+static uint32_t tiff_get(const uint8_t *p, int bytes, int le)
+{
+	uint32_t v = 0;
+	int i;
+	for(i = 0; i < bytes; i++) v |= (uint32_t)p[le ? i : bytes - 1 - i] << (i * 8);
+	return v;
+}
+
+/* Finds tag in IFD at given offset, returns pointer to its value. */
+static const uint8_t *tiff_tag(const uint8_t *tiff, size_t len, uint32_t ifd, uint16_t tag, uint32_t *count, int le)
+{
+	uint32_t entries, i;
+	if(ifd + 2 > len) return NULL;
+	entries = tiff_get(tiff + ifd, 2, le);
+	for(i = 0; i < entries && ifd + 2 + (i + 1) * 12 <= len; i++) {
+		const uint8_t *e = tiff + ifd + 2 + i * 12;
+		if(tiff_get(e, 2, le) != tag) continue;
+		*count = tiff_get(e + 4, 4, le);
+		if(*count <= 4) return e + 8;
+		if(tiff_get(e + 8, 4, le) + *count > len) return NULL;
+		return tiff + tiff_get(e + 8, 4, le);
+	}
+	return NULL;
+}
+
+/* EXIF DateTimeOriginal with SubSecTimeOriginal as seconds, time zone is
+ * not recorded by cameras, so UTC is assumed. */
+static int exif_time(const uint8_t *tiff, size_t len, double *time)
+{
+	const uint8_t *p;
+	uint32_t count, exif;
+	struct tm tm;
+	int le;
+	char subsec[16] = "0.";
+	if(len < 8) return 0;
+	le = tiff[0] == 'I';
+	if(!(p = tiff_tag(tiff, len, tiff_get(tiff + 4, 4, le), 0x8769, &count, le))) return 0;
+	exif = tiff_get(p, 4, le);
+	if(!(p = tiff_tag(tiff, len, exif, 0x9003, &count, le)) || count < 19) return 0;
+	memset(&tm, 0, sizeof(tm));
+	if(sscanf((const char *)p, "%4d:%2d:%2d %2d:%2d:%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+	          &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) return 0;
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	*time = timegm(&tm);
+	if((p = tiff_tag(tiff, len, exif, 0x9291, &count, le)) && count < sizeof(subsec) - 2) {
+		memcpy(subsec + 2, p, count);
+		*time += atof(subsec);
+	}
+	return 1;
+}
+
+int jpeg_time(const char *path, double *time)
+{
+	JPEG_CHUNK chunk;
+	uint8_t buf[64 * 1024];
+	int ret = 0;
+	FILE *in = fopen(path, "rb");
+	if(!in) return 0;
+
+	if(fread(&chunk.marker, 1, sizeof(chunk.marker), in) == sizeof(chunk.marker) &&
+	   ntohs(chunk.marker) == JPEG_HEAD_MARKER) {
+		while(fread(&chunk, 1, sizeof(chunk), in) == sizeof(chunk)) {
+			size_t len;
+			chunk.marker = ntohs(chunk.marker);
+			chunk.size   = ntohs(chunk.size);
+			if((chunk.marker & JPEG_MARKER_MASK) != JPEG_MARKER_MASK || chunk.marker == JPEG_SOS_MARKER) break;
+			if(chunk.marker != JPEG_APP1_MARKER || chunk.size < sizeof(chunk.size) + 6) {
+				fseek(in, chunk.size - sizeof(chunk.size), SEEK_CUR);
+				continue;
+			}
+			len = chunk.size - sizeof(chunk.size);
+			if(fread(buf, 1, len, in) != len) break;
+			if(!memcmp(buf, "Exif\0\0", 6)) {
+				ret = exif_time(buf + 6, len - 6, time);
+				break;
+			}
+		}
+	}
+
+	fclose(in);
+	return ret;
+}
+
+/* Lossless Huffman table optimization of baseline JPEG. Entropy coded data
+ * is decoded to Huffman symbols with their extra bits, which are counted
+ * and coded again with optimal tables (ITU T.81 Annex K.2). Coefficients
+ * are never reconstructed, so pixels stay bit exact. */
+
+#define JPEG_SOF0_MARKER 0xFFC0
+#define JPEG_SOF1_MARKER 0xFFC1
+#define JPEG_DHT_MARKER  0xFFC4
+#define JPEG_DAC_MARKER  0xFFCC
+#define JPEG_RST0_MARKER 0xFFD0
+#define JPEG_EOI_MARKER  0xFFD9
+#define JPEG_DRI_MARKER  0xFFDD
+
+#define HUFF_LOOKUP   9          /* bits decoded by single table lookup */
+#define HUFF_RESTART  0xFFFFFFFF /* symbol list entry for restart marker */
+
+/* Annex K.3 tables, used by Motion JPEG frames that leave out DHT */
+static const uint8_t huff_std_bits[4][16] = {
+	{ 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 },
+	{ 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d },
+	{ 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 }
+};
+
+static const uint8_t huff_std_vals[4][162] = {
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+	{
+		0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+		0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+		0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+		0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+		0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+		0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+		0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+		0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+		0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa
+	}, {
+		0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+		0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+		0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+		0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+		0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+		0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+		0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+		0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+		0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+		0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+		0xf9, 0xfa
+	}
+};
+
+typedef struct {
+	int      defined;
+	uint8_t  bits[17];     /* codes of each length, bits[0] unused */
+	uint8_t  vals[256];
+	/* decoder */
+	uint16_t lookup[1 << HUFF_LOOKUP]; /* length << 8 | value, 0 for longer codes */
+	int32_t  maxcode[18];
+	int32_t  valptr[17];
+	int32_t  mincode[17];
+	/* encoder */
+	uint16_t code[256];
+	uint8_t  size[256];
+} HUFF;
+
+typedef struct {
+	int id, h, v;
+	int dc, ac;            /* table selectors from scan header */
+} HUFF_COMP;
+
+typedef struct {
+	const uint8_t *p, *end;
+	uint64_t acc;
+	int      bits;         /* valid bits in acc */
+	int      fake;         /* zero bytes added past the data */
+} HUFF_READER;
+
+typedef struct {
+	uint8_t *buf;
+	size_t   len, cap;
+	uint64_t acc;
+	int      bits;
+	int      failed;
+} HUFF_WRITER;
+
+/* Builds decoding and encoding tables, returns 0 for invalid table. */
+static int huff_build(HUFF *t)
+{
+	int32_t code = 0;
+	int l, i, k = 0;
+	memset(t->lookup, 0, sizeof(t->lookup));
+	for(l = 1; l <= 16; l++) {
+		t->valptr[l] = k;
+		t->mincode[l] = code;
+		/* more codes than fit in l bits would overrun lookup */
+		if(code + t->bits[l] > (1 << l) || k + t->bits[l] > 256) return 0;
+		for(i = 0; i < t->bits[l]; i++, k++, code++) {
+			t->code[t->vals[k]] = code;
+			t->size[t->vals[k]] = l;
+			if(l <= HUFF_LOOKUP) {
+				int fill = 1 << (HUFF_LOOKUP - l), j;
+				for(j = 0; j < fill; j++) t->lookup[(code << (HUFF_LOOKUP - l)) + j] = (l << 8) | t->vals[k];
+			}
+		}
+		t->maxcode[l] = t->bits[l] ? code - 1 : -1;
+		code <<= 1;
+	}
+	t->maxcode[17] = 0x7FFFFFFF;
+	return 1;
+}
+
+static void huff_std(HUFF *t, int index)
+{
+	int i, n = 0;
+	memset(t, 0, sizeof(*t));
+	for(i = 0; i < 16; i++) n += t->bits[i + 1] = huff_std_bits[index][i];
+	memcpy(t->vals, huff_std_vals[index], n);
+	t->defined = 1;
+	huff_build(t);
+}
+
+/* Optimal code lengths limited to 16 bits, jpeg_gen_optimal_table of IJG
+ * libjpeg. All ones code stays reserved. */
+static int huff_optimal(HUFF *t, const uint32_t *counts)
+{
+	uint64_t freq[257];
+	int codesize[257], others[257], bits[33];
+	int c1, c2, i, j, p;
+	memset(codesize, 0, sizeof(codesize));
+	memset(bits, 0, sizeof(bits));
+	for(i = 0; i < 256; i++) freq[i] = counts[i];
+	freq[256] = 1;
+	for(i = 0; i < 257; i++) others[i] = -1;
+
+	for(;;) {
+		uint64_t v = UINT64_MAX;
+		c1 = c2 = -1;
+		for(i = 0; i <= 256; i++) if(freq[i] && freq[i] <= v) v = freq[i], c1 = i;
+		v = UINT64_MAX;
+		for(i = 0; i <= 256; i++) if(freq[i] && freq[i] <= v && i != c1) v = freq[i], c2 = i;
+		if(c2 < 0) break;
+		freq[c1] += freq[c2];
+		freq[c2] = 0;
+		codesize[c1]++;
+		while(others[c1] >= 0) codesize[c1 = others[c1]]++;
+		others[c1] = c2;
+		codesize[c2]++;
+		while(others[c2] >= 0) codesize[c2 = others[c2]]++;
+	}
+	for(i = 0; i <= 256; i++) {
+		if(!codesize[i]) continue;
+		if(codesize[i] > 32) return 0;
+		bits[codesize[i]]++;
+	}
+	/* move codes longer than 16 bits up the tree */
+	for(i = 32; i > 16; i--) {
+		while(bits[i] > 0) {
+			j = i - 2;
+			while(bits[j] == 0) j--;
+			bits[i] -= 2;
+			bits[i - 1]++;
+			bits[j + 1] += 2;
+			bits[j]--;
+		}
+	}
+	/* drop reserved code, which is the longest one */
+	while(bits[i] == 0) i--;
+	bits[i]--;
+
+	memset(t, 0, sizeof(*t));
+	for(i = 1; i <= 16; i++) t->bits[i] = bits[i];
+	for(p = 0, i = 1; i <= 32; i++) {
+		for(j = 0; j < 256; j++) if(codesize[j] == i) t->vals[p++] = j;
+	}
+	t->defined = 1;
+	return huff_build(t);
+}
+
+static void huff_fill(HUFF_READER *r)
+{
+	while(r->bits <= 56) {
+		uint8_t b = 0;
+		if(r->p < r->end && (*r->p != 0xFF || (r->p + 1 < r->end && r->p[1] == 0))) {
+			/* stuffed zero after 0xFF is skipped */
+			b = *r->p;
+			r->p += b == 0xFF ? 2 : 1;
+		} else {
+			/* marker or end of data, decoder fails if it gets here */
+			r->fake++;
+		}
+		r->acc = (r->acc << 8) | b;
+		r->bits += 8;
+	}
+}
+
+static inline uint32_t huff_bits(HUFF_READER *r, int n)
+{
+	uint32_t v;
+	if(!n) return 0;
+	if(r->bits < n) huff_fill(r);
+	v = (r->acc >> (r->bits - n)) & ((1u << n) - 1);
+	r->bits -= n;
+	return v;
+}
+
+static inline int huff_decode(HUFF_READER *r, const HUFF *t)
+{
+	uint32_t e;
+	int l;
+	if(r->bits < 16) huff_fill(r);
+	e = t->lookup[(r->acc >> (r->bits - HUFF_LOOKUP)) & ((1 << HUFF_LOOKUP) - 1)];
+	if(e) {
+		r->bits -= e >> 8;
+		return e & 0xFF;
+	}
+	for(l = HUFF_LOOKUP + 1; l <= 16; l++) {
+		int32_t code = (r->acc >> (r->bits - l)) & ((1 << l) - 1);
+		if(code <= t->maxcode[l]) {
+			r->bits -= l;
+			return t->vals[t->valptr[l] + code - t->mincode[l]];
+		}
+	}
+	return -1;
+}
+
+/* Marker after entropy coded segment, restart marker or end of scan. Data
+ * bits left must be only padding of last byte. */
+static const uint8_t *huff_marker(HUFF_READER *r)
+{
+	if(r->fake * 8 > r->bits || r->bits - r->fake * 8 >= 8) return NULL;
+	while(r->p + 1 < r->end && r->p[0] == 0xFF && r->p[1] == 0xFF) r->p++;
+	return r->p + 1 < r->end && r->p[0] == 0xFF ? r->p : NULL;
+}
+
+static int huff_store(uint32_t **syms, size_t *count, size_t *alloc, uint32_t s)
+{
+	if(*count >= *alloc) {
+		uint32_t *grown = realloc(*syms, (*alloc ? *alloc * 2 : 65536) * sizeof(uint32_t));
+		if(!grown) return 0;
+		*syms = grown;
+		*alloc = *alloc ? *alloc * 2 : 65536;
+	}
+	(*syms)[(*count)++] = s;
+	return 1;
+}
+
+static void huff_put(HUFF_WRITER *w, const void *data, size_t len)
+{
+	if(w->len + len > w->cap) {
+		size_t cap = (w->len + len) * 2;
+		uint8_t *grown = realloc(w->buf, cap);
+		if(!grown) {
+			w->failed = 1;
+			return;
+		}
+		w->buf = grown;
+		w->cap = cap;
+	}
+	memcpy(w->buf + w->len, data, len);
+	w->len += len;
+}
+
+static inline void huff_emit(HUFF_WRITER *w, uint32_t code, int size)
+{
+	w->acc = (w->acc << size) | code;
+	w->bits += size;
+	while(w->bits >= 8) {
+		uint8_t b[2] = { (w->acc >> (w->bits - 8)) & 0xFF, 0 };
+		w->bits -= 8;
+		huff_put(w, b, b[0] == 0xFF ? 2 : 1);
+	}
+}
+
+/* Pads last byte with ones. */
+static void huff_align(HUFF_WRITER *w)
+{
+	if(w->bits) huff_emit(w, (1 << (8 - w->bits)) - 1, 8 - w->bits);
+}
+
+size_t jpeg_optimize(const uint8_t *in, size_t len, uint8_t **out, size_t *cap)
+{
+	HUFF tables[2][4], *opt = NULL;
+	HUFF_COMP comps[4], *scan[4];
+	HUFF_WRITER w;
+	HUFF_READER r;
+	uint32_t counts[2][4][256], *syms = NULL, ri = 0, s;
+	size_t pos = 2, count = 0, alloc = 0, scanPos = 0, scanLen = 0, n, i;
+	const uint8_t *end = in + len, *rest = NULL;
+	int width = 0, height = 0, ncomps = 0, ns = 0, hmax = 1, vmax = 1, used[2][4];
+	int mcus, mcusX, mcusY, mcu, c, b, k, sym, rst = 0;
+
+	memset(tables, 0, sizeof(tables));
+	memset(&w, 0, sizeof(w));
+	w.buf = *out;
+	w.cap = *cap;
+	if(len < 4 || in[0] != 0xFF || in[1] != 0xD8) return 0;
+	huff_put(&w, in, 2);
+
+	/* walk markers up to scan, keeping all but Huffman tables */
+	while(!scanPos) {
+		uint16_t marker, size;
+		const uint8_t *seg;
+		if(pos + 4 > len || in[pos] != 0xFF) goto fail;
+		if(in[pos + 1] == 0xFF) {
+			pos++;
+			continue;
+		}
+		marker = in[pos] << 8 | in[pos + 1];
+		size = in[pos + 2] << 8 | in[pos + 3];
+		seg = in + pos + 4;
+		if(size < 2 || pos + 2 + size > len) goto fail;
+		switch(marker) {
+		case JPEG_SOF0_MARKER:
+		case JPEG_SOF1_MARKER:
+			if(size < 8 || seg[0] != 8) goto fail;
+			height = seg[1] << 8 | seg[2];
+			width = seg[3] << 8 | seg[4];
+			ncomps = seg[5];
+			if(!width || !height || ncomps < 1 || ncomps > 4 || size < 8 + 3 * ncomps) goto fail;
+			for(c = 0; c < ncomps; c++) {
+				comps[c].id = seg[6 + 3 * c];
+				comps[c].h = seg[7 + 3 * c] >> 4;
+				comps[c].v = seg[7 + 3 * c] & 15;
+				if(comps[c].h < 1 || comps[c].h > 4 || comps[c].v < 1 || comps[c].v > 4) goto fail;
+				if(comps[c].h > hmax) hmax = comps[c].h;
+				if(comps[c].v > vmax) vmax = comps[c].v;
+			}
+			break;
+		case JPEG_DHT_MARKER:
+			for(n = 0; n + 17 <= size - 2u; ) {
+				int tc = seg[n] >> 4, th = seg[n] & 15, total = 0;
+				HUFF *t;
+				if(tc > 1 || th > 3) goto fail;
+				t = &tables[tc][th];
+				memset(t, 0, sizeof(*t));
+				for(i = 0; i < 16; i++) total += t->bits[i + 1] = seg[n + 1 + i];
+				if(n + 17 + total > size - 2u || total > 256) goto fail;
+				memcpy(t->vals, seg + n + 17, total);
+				if(!huff_build(t)) goto fail;
+				t->defined = 1;
+				n += 17 + total;
+			}
+			break;
+		case JPEG_DRI_MARKER:
+			if(size < 4) goto fail;
+			ri = seg[0] << 8 | seg[1];
+			break;
+		case JPEG_SOS_MARKER:
+			if(!ncomps || size < 6 + 2 * seg[0]) goto fail;
+			ns = seg[0];
+			if(ns < 1 || ns > ncomps) goto fail;
+			for(i = 0; i < (size_t)ns; i++) {
+				for(c = 0; c < ncomps && comps[c].id != seg[1 + 2 * i]; c++);
+				if(c == ncomps) goto fail;
+				scan[i] = &comps[c];
+				scan[i]->dc = seg[2 + 2 * i] >> 4;
+				scan[i]->ac = seg[2 + 2 * i] & 15;
+				if(scan[i]->dc > 3 || scan[i]->ac > 3) goto fail;
+			}
+			/* baseline spectral selection and no successive approximation */
+			if(seg[1 + 2 * ns] != 0 || seg[2 + 2 * ns] != 63 || seg[3 + 2 * ns] != 0) goto fail;
+			scanPos = pos;
+			scanLen = 2 + size;
+			break;
+		case JPEG_DAC_MARKER:
+		case JPEG_EOI_MARKER:
+			goto fail;
+		default:
+			/* progressive, lossless and arithmetic coded frames stay as they are */
+			if(marker >= 0xFFC0 && marker <= 0xFFCF) goto fail;
+			break;
+		}
+		if(marker != JPEG_DHT_MARKER && marker != JPEG_SOS_MARKER) huff_put(&w, in + pos, 2 + size);
+		pos += 2 + size;
+	}
+	if(!ncomps) goto fail;
+
+	/* decode symbols of the scan */
+	memset(counts, 0, sizeof(counts));
+	memset(used, 0, sizeof(used));
+	for(i = 0; i < (size_t)ns; i++) {
+		if(!tables[0][scan[i]->dc].defined) huff_std(&tables[0][scan[i]->dc], scan[i]->dc ? 1 : 0);
+		if(!tables[1][scan[i]->ac].defined) huff_std(&tables[1][scan[i]->ac], scan[i]->ac ? 3 : 2);
+		used[0][scan[i]->dc] = used[1][scan[i]->ac] = 1;
+	}
+	if(ns == 1) {
+		/* non-interleaved scan goes block by block */
+		mcusX = ((width * scan[0]->h + hmax - 1) / hmax + 7) / 8;
+		mcusY = ((height * scan[0]->v + vmax - 1) / vmax + 7) / 8;
+		scan[0]->h = scan[0]->v = 1;
+	} else {
+		mcusX = (width + 8 * hmax - 1) / (8 * hmax);
+		mcusY = (height + 8 * vmax - 1) / (8 * vmax);
+	}
+	mcus = mcusX * mcusY;
+	memset(&r, 0, sizeof(r));
+	r.p = in + pos;
+	r.end = end;
+	for(mcu = 0; mcu < mcus; mcu++) {
+		if(ri && mcu && mcu % ri == 0) {
+			const uint8_t *m = huff_marker(&r);
+			if(!m || m[1] != (JPEG_RST0_MARKER & 0xFF) + (rst++ & 7)) goto fail;
+			memset(&r, 0, sizeof(r));
+			r.p = m + 2;
+			r.end = end;
+			if(!huff_store(&syms, &count, &alloc, HUFF_RESTART)) goto fail;
+		}
+		for(c = 0; c < ns; c++) {
+			HUFF *dc = &tables[0][scan[c]->dc], *ac = &tables[1][scan[c]->ac];
+			for(b = 0; b < scan[c]->h * scan[c]->v; b++) {
+				for(k = 0; k < 64; ) {
+					int bits;
+					if((sym = huff_decode(&r, k ? ac : dc)) < 0 || (!k && sym > 11)) goto fail;
+					bits = sym & 15;
+					counts[k ? 1 : 0][k ? scan[c]->ac : scan[c]->dc][sym]++;
+					/* symbol, its extra bits and table slot */
+					s = (uint32_t)sym | huff_bits(&r, bits) << 8 | (uint32_t)(k ? 4 + scan[c]->ac : scan[c]->dc) << 24;
+					if(!huff_store(&syms, &count, &alloc, s)) goto fail;
+					if(!k) k = 1;
+					else if(sym == 0) break;          /* end of block */
+					else if(sym == 0xF0) k += 16;     /* run of 16 zeros */
+					else k += (sym >> 4) + 1;
+				}
+				if(k > 64) goto fail;
+			}
+		}
+	}
+	if(!(rest = huff_marker(&r)) || rest[1] != (JPEG_EOI_MARKER & 0xFF)) goto fail;
+
+	/* optimal tables for used slots, written before scan header */
+	if(!(opt = calloc(8, sizeof(HUFF)))) goto fail;
+	{
+		uint8_t hdr[4] = { 0xFF, 0xC4, 0, 0 };
+		size_t hdrPos = w.len, segLen = 2;
+		huff_put(&w, hdr, sizeof(hdr));
+		for(c = 0; c < 2; c++) {
+			for(i = 0; i < 4; i++) {
+				uint8_t th = c << 4 | i;
+				int total = 0;
+				if(!used[c][i]) continue;
+				if(!huff_optimal(&opt[c * 4 + i], counts[c][i])) goto fail;
+				huff_put(&w, &th, 1);
+				huff_put(&w, opt[c * 4 + i].bits + 1, 16);
+				for(k = 1; k <= 16; k++) total += opt[c * 4 + i].bits[k];
+				huff_put(&w, opt[c * 4 + i].vals, total);
+				segLen += 17 + total;
+			}
+		}
+		if(w.failed) goto fail;
+		w.buf[hdrPos + 2] = segLen >> 8;
+		w.buf[hdrPos + 3] = segLen & 0xFF;
+	}
+	huff_put(&w, in + scanPos, scanLen);
+
+	/* encode symbols again */
+	for(rst = 0, i = 0; i < count; i++) {
+		const HUFF *t;
+		s = syms[i];
+		if(s == HUFF_RESTART) {
+			uint8_t m[2] = { 0xFF, (JPEG_RST0_MARKER & 0xFF) + (rst++ & 7) };
+			huff_align(&w);
+			huff_put(&w, m, 2);
+			continue;
+		}
+		t = &opt[s >> 24];
+		sym = s & 0xFF;
+		huff_emit(&w, t->code[sym], t->size[sym]);
+		if(sym & 15) huff_emit(&w, (s >> 8) & 0xFFFF, sym & 15);
+	}
+	huff_align(&w);
+	huff_put(&w, rest, end - rest);
+	free(syms);
+	free(opt);
+	*out = w.buf;
+	*cap = w.cap;
+	return !w.failed && w.len < len ? w.len : 0;
+
+fail:
+	free(syms);
+	free(opt);
+	*out = w.buf;
+	*cap = w.cap;
+	return 0;
+}
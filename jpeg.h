@@ -23,4 +23,13 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
-int jpeg_size(const char *path, int *width, int *height);
\ No newline at end of file
+int jpeg_size(const char *path, int *width, int *height);
+/* Same for JPEG file contents in memory. */
+int jpeg_size_data(const void *data, size_t len, int *width, int *height);
+/* Capture time from EXIF DateTimeOriginal in seconds. */
+int jpeg_time(const char *path, double *time);
+/* Re-encodes baseline JPEG with optimal Huffman tables made from its own
+ * symbols, decoded image stays bit exact. Output buffer is grown as needed.
+ * Returns new size, 0 when frame is not baseline Huffman coded, is damaged
+ * or would not get smaller. */
+size_t jpeg_optimize(const uint8_t *in, size_t len, uint8_t **out, size_t *cap);
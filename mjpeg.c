@@ -27,35 +27,147 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <sys/stat.h>
 
 #include "riff.h"
 #include "mp3.h"
 #include "jpeg.h"
+#include "throttle.h"
+#include "frames.h"
+#include "writer.h"
+#include "stats.h"
+#include "probes.h"
+#include "activity.h"
+#include "mux.h"
+#include "watch.h"
+#include "batch.h"
+#include "segment.h"
+#include "verify.h"
+#include "multipart.h"
+#include "seekmap.h"
 
 #define DEFAULT_FPS 25
+#define DEFAULT_REFRESH 10
+#define MAX_TEES        8
+
+/* Additional output fed with frames read for the main one. */
+typedef struct {
+	char *path;
+	int   every;
+	int   fps;   /* 0 for same as main output */
+	int   audio;
+	FILE *out;
+	MUX   mux;
+} TEE;
+
+static STATS *stats;
+static volatile sig_atomic_t stopped;
+
+static void stop(int sig)
+{
+	(void)sig;
+	stopped = 1;
+}
+
+/* Next segment could not be started, finished ones are complete, so only
+ * background work is left. Returns exit code. */
+static int rollover_failed(SEGMENT *segment)
+{
+	segment_close(segment);
+	return 3;
+}
+
+/* Makes file being recorded playable, returns time of next refresh. */
+static uint64_t refresh_output(MUX *m, SEGMENT *segment, WRITER *writer, int refresh)
+{
+	mux_refresh(m);
+	writer_sync(segment ? segment_writer(segment) : writer);
+	return stats_now() + refresh * 1000000000ull;
+}
+
+/* First frame of live input decides dimensions and starts the file. */
+static int begin_live(MUX *m, FILE *out, const char *outPath, int width, int height)
+{
+	m->vids[0].width = width;
+	m->vids[0].height = height;
+	fprintf(stderr, "AVI `%s' %dx%d\n", outPath, width, height);
+	if(!mux_begin(m, out)) {
+		fprintf(stderr, "Error: Cannot create temporary index for `%s'.\n", outPath);
+		return 0;
+	}
+	return 1;
+}
+
+static void print_throttled(THROTTLE *readLimit, THROTTLE *writeLimit)
+{
+	if(readLimit || writeLimit) {
+		fprintf(stderr, "Throttled reads %.1f s, writes %.1f s\n",
+			throttle_waited(readLimit) / 1e9, throttle_waited(writeLimit) / 1e9);
+	}
+}
+
+/* Parses output.avi[,every=N][,fps=N][,noaudio] */
+static int parse_tee(TEE *t, const char *spec)
+{
+	const char *opt = spec + strcspn(spec, ",");
+	if(opt == spec || !(t->path = strndup(spec, opt - spec))) return 0;
+	t->every = 1;
+	t->fps = 0;
+	t->audio = 1;
+	while(*opt++ == ',') {
+		size_t len = strcspn(opt, ",");
+		if(!strncmp(opt, "every=", 6)) {
+			if((t->every = atoi(opt + 6)) <= 0) return 0;
+		} else if(!strncmp(opt, "fps=", 4)) {
+			if((t->fps = atoi(opt + 4)) <= 0) return 0;
+		} else if(len == 7 && !strncmp(opt, "noaudio", 7)) {
+			t->audio = 0;
+		} else {
+			return 0;
+		}
+		opt += len;
+	}
+	return 1;
+}
 
 void help(const char *program)
 {
-	fprintf(stderr, "Usage: %s [-f fps] [-o output.avi] [-s input.mp3] input1.jpg [input2.jpg ...]\n", program);
+	fprintf(stderr, "Usage: %s [-f fps] [-o output.avi] [-s input.mp3] [-l frames.txt] [--uring] [--buffer MB] [--direct] [--dontneed] [--prealloc] [--stats[=json]] [--every N] [--duration seconds] [--timestamps mtime|exif|list] [--stream frames.txt] [--watch dir] [--multipart source] [--max-part MB] [--refresh seconds] [--segment-size MB] [--segment-time seconds] [--retain MB] [--checksum] [--optimize] [--seek-map[=json]] [--fast-start] [--events] [--event-threshold score] [--max-read-mibps MiB] [--max-write-mibps MiB] [--io-burst MiB] [--tee output.avi[,every=N][,fps=N][,noaudio]] [--jobs N] input1.jpg [input2.jpg ...]\n", program);
+	fprintf(stderr, "       %s [-f fps] [--uring] [--buffer MB] [--direct] [--dontneed] [--stats[=json]] [--every N] [--duration seconds] [--checksum] [--optimize] [--seek-map[=json]] [--fast-start] [--events] [--event-threshold score] [--max-read-mibps MiB] [--max-write-mibps MiB] [--io-burst MiB] [--jobs N] --batch manifest.txt\n", program);
+	fprintf(stderr, "       %s [-f fps] [--uring] [--buffer MB] [--direct] [--dontneed] [--stats[=json]] [--every N] [--duration seconds] [--checksum] [--optimize] [--seek-map[=json]] [--fast-start] [--events] [--event-threshold score] [--max-read-mibps MiB] [--max-write-mibps MiB] [--io-burst MiB] [--jobs N] --daemon socket\n", program);
+	fprintf(stderr, "       %s [--jobs N] --verify output1.avi [output2.avi ...]\n", program);
 }
 
 int main(int argc, char const *argv[])
 {
-	int argi, fps = DEFAULT_FPS, width, height;
-	const char *outPath = NULL, *sndPath = NULL;
-	fpos_t riffPos, hdrlPos, strlPos, moviPos, sndDataPos, sndFmtPos;
-	size_t riffSize, hdrlSize, strlSize, moviSize, read, sndFmtSize;
-	AVIH avih;
-	STRH strh;
-	BMPH bmph;
-	VPRP vprp;
-	WAVH wavh;
-	ADPCMH adpcmh;
-	MP3H mp3h;
-	int frame = 0;
-	FILE *out, *idx, *snd = NULL, *in;
-	mp3header_t mp3 = 0;
-	double videoFrameLength, audio = 0, video = 0;
+	int argi, fps = DEFAULT_FPS, width, height, count = 0;
+	const char *outPath = NULL, *sndPath = NULL, **paths = NULL, *watchDir = NULL, *manifest = NULL;
+	const char *source = NULL, *daemonPath = NULL;
+	size_t maxPart = MULTIPART_MAXPART;
+	int backend = FRAMES_STDIO, writerFlags = 0, prealloc = 0, refresh = DEFAULT_REFRESH, jobs = 0;
+	int segmentTime = 0;
+	uint64_t segmentSize = 0, retain = 0;
+	const char **streamPaths[MUX_STREAMS] = { NULL };
+	int streamCounts[MUX_STREAMS] = { 0 }, streams = 1, i;
+	int checksums = 0, verify = 0, optimize = 0, seekmap = 0, fastStart = 0;
+	double maxRead = 0, maxWrite = 0, burst = 0, events = 0;
+	THROTTLE *readLimit = NULL, *writeLimit = NULL;
+	TEE tees[MAX_TEES];
+	int teeCount = 0;
+	int every = 0, duration = 0, timeSource = -1, *repeats = NULL, slots;
+	size_t bufSize = WRITER_BUFSIZE;
+	FILE *out = NULL;
+	WRITER *writer = NULL;
+	WATCH *watch = NULL;
+	MULTIPART *multipart = NULL;
+	SEGMENT *segment = NULL;
+	MUX mux;
+	STATS statsData;
+	int statsFormat = 0;
+	uint64_t start;
+
+	stats_init(&statsData);
 
 	/* read command line */
 	for(argi = 1; argi < argc && *argv[argi] == '-'; argi++) {
@@ -72,281 +184,510 @@ int main(int argc, char const *argv[])
 				fprintf(stderr, "Error: Invalid FPS value `%s'.\n", argv[argi]);
 				return 255;
 			}
+		} else if(!strcmp(argv[argi], "-l") && argi + 1 < argc) {
+			if(!frames_list(argv[++argi], &paths, &count)) {
+				fprintf(stderr, "Error: Cannot read frame list `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--stream") && argi + 1 < argc) {
+			if(streams >= MUX_STREAMS) {
+				fprintf(stderr, "Error: Too many video streams, at most %d.\n", MUX_STREAMS);
+				return 255;
+			}
+			if(!frames_list(argv[++argi], &streamPaths[streams], &streamCounts[streams]) || !streamCounts[streams]) {
+				fprintf(stderr, "Error: Cannot read frame list `%s'.\n", argv[argi]);
+				return 255;
+			}
+			streams++;
+		} else if(!strcmp(argv[argi], "--every") && argi + 1 < argc) {
+			every = atoi(argv[++argi]);
+			if(every <= 0) {
+				fprintf(stderr, "Error: Invalid frame stride `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--duration") && argi + 1 < argc) {
+			duration = atoi(argv[++argi]);
+			if(duration <= 0) {
+				fprintf(stderr, "Error: Invalid duration `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--timestamps") && argi + 1 < argc) {
+			argi++;
+			if(!strcmp(argv[argi], "mtime")) {
+				timeSource = FRAMES_TIME_MTIME;
+			} else if(!strcmp(argv[argi], "exif")) {
+				timeSource = FRAMES_TIME_EXIF;
+			} else if(!strcmp(argv[argi], "list")) {
+				timeSource = FRAMES_TIME_LIST;
+			} else {
+				fprintf(stderr, "Error: Invalid timestamp source `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--uring")) {
+			backend = FRAMES_URING;
+		} else if(!strcmp(argv[argi], "--buffer") && argi + 1 < argc) {
+			bufSize = (size_t)atoi(argv[++argi]) * 1024 * 1024;
+			if(bufSize == 0) {
+				fprintf(stderr, "Error: Invalid buffer size `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--direct")) {
+			writerFlags |= WRITER_DIRECT;
+		} else if(!strcmp(argv[argi], "--dontneed")) {
+			writerFlags |= WRITER_DONTNEED;
+		} else if(!strcmp(argv[argi], "--prealloc")) {
+			prealloc = 1;
+		} else if(!strcmp(argv[argi], "--stats")) {
+			statsFormat = STATS_TEXT;
+		} else if(!strcmp(argv[argi], "--stats=json")) {
+			statsFormat = STATS_JSON;
+		} else if(!strcmp(argv[argi], "--watch") && argi + 1 < argc) {
+			watchDir = argv[++argi];
+		} else if(!strcmp(argv[argi], "--multipart") && argi + 1 < argc) {
+			source = argv[++argi];
+		} else if(!strcmp(argv[argi], "--max-part") && argi + 1 < argc) {
+			maxPart = (size_t)atoi(argv[++argi]) * 1024 * 1024;
+			if(maxPart == 0) {
+				fprintf(stderr, "Error: Invalid part size limit `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--refresh") && argi + 1 < argc) {
+			refresh = atoi(argv[++argi]);
+			if(refresh <= 0) {
+				fprintf(stderr, "Error: Invalid refresh interval `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--batch") && argi + 1 < argc) {
+			manifest = argv[++argi];
+		} else if(!strcmp(argv[argi], "--daemon") && argi + 1 < argc) {
+			daemonPath = argv[++argi];
+		} else if(!strcmp(argv[argi], "--checksum")) {
+			checksums = 1;
+		} else if(!strcmp(argv[argi], "--seek-map")) {
+			seekmap |= SEEKMAP_BINARY;
+		} else if(!strcmp(argv[argi], "--seek-map=json")) {
+			seekmap |= SEEKMAP_JSON;
+		} else if(!strcmp(argv[argi], "--tee") && argi + 1 < argc) {
+			if(teeCount == MAX_TEES) {
+				fprintf(stderr, "Error: Too many tee outputs, up to %d supported.\n", MAX_TEES);
+				return 255;
+			}
+			if(!parse_tee(&tees[teeCount++], argv[++argi])) {
+				fprintf(stderr, "Error: Invalid tee output `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--fast-start")) {
+			fastStart = 1;
+		} else if(!strcmp(argv[argi], "--events")) {
+			if(!events) events = ACTIVITY_THRESHOLD;
+		} else if(!strcmp(argv[argi], "--event-threshold") && argi + 1 < argc) {
+			if((events = atof(argv[++argi])) <= 0) {
+				fprintf(stderr, "Error: Invalid event threshold `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--max-read-mibps") && argi + 1 < argc) {
+			if((maxRead = atof(argv[++argi])) <= 0) {
+				fprintf(stderr, "Error: Invalid read rate limit `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--max-write-mibps") && argi + 1 < argc) {
+			if((maxWrite = atof(argv[++argi])) <= 0) {
+				fprintf(stderr, "Error: Invalid write rate limit `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--io-burst") && argi + 1 < argc) {
+			if((burst = atof(argv[++argi])) <= 0) {
+				fprintf(stderr, "Error: Invalid burst size `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--optimize")) {
+			optimize = 1;
+		} else if(!strcmp(argv[argi], "--verify")) {
+			verify = 1;
+		} else if(!strcmp(argv[argi], "--jobs") && argi + 1 < argc) {
+			jobs = atoi(argv[++argi]);
+			if(jobs <= 0) {
+				fprintf(stderr, "Error: Invalid number of jobs `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--segment-size") && argi + 1 < argc) {
+			segmentSize = (uint64_t)atoi(argv[++argi]) * 1024 * 1024;
+			if(segmentSize == 0) {
+				fprintf(stderr, "Error: Invalid segment size `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--segment-time") && argi + 1 < argc) {
+			segmentTime = atoi(argv[++argi]);
+			if(segmentTime <= 0) {
+				fprintf(stderr, "Error: Invalid segment duration `%s'.\n", argv[argi]);
+				return 255;
+			}
+		} else if(!strcmp(argv[argi], "--retain") && argi + 1 < argc) {
+			retain = (uint64_t)atoi(argv[++argi]) * 1024 * 1024;
+			if(retain == 0) {
+				fprintf(stderr, "Error: Invalid retention budget `%s'.\n", argv[argi]);
+				return 255;
+			}
+		}
+	}
+
+	/* remaining arguments follow frames from lists */
+	if(argi < argc) {
+		const char **grown = realloc(paths, (count + argc - argi) * sizeof(char *));
+		if(!grown) return 255;
+		paths = grown;
+		while(argi < argc) paths[count++] = argv[argi++];
+	}
+
+	if(verify) {
+		int failed = 0, bad;
+		if(count == 0) {
+			help(argv[0]);
+			return 255;
+		}
+		for(i = 0; i < count; i++) {
+			if((bad = verify_file(paths[i], jobs)) < 0) {
+				fprintf(stderr, "Error: Cannot read checksums of `%s'.\n", paths[i]);
+			}
+			if(bad) failed++;
 		}
+		return failed ? 8 : 0;
 	}
 
-	if(argi >= argc) {
+	/* one bucket per direction, shared by every reader and writer */
+	readLimit = throttle_open(maxRead * 1024 * 1024, burst * 1024 * 1024);
+	writeLimit = throttle_open(maxWrite * 1024 * 1024, burst * 1024 * 1024);
+
+	if(daemonPath) {
+		BATCH batch = { jobs, fps, backend, bufSize, writerFlags, statsFormat, every, duration, checksums, optimize, seekmap, fastStart, events, readLimit, writeLimit };
+		struct sigaction sa;
+		int served;
+		/* no SA_RESTART, accept returns so the daemon stops */
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = stop;
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+		served = batch_serve(&batch, daemonPath, &stopped);
+		if(served) print_throttled(readLimit, writeLimit);
+		throttle_close(readLimit);
+		throttle_close(writeLimit);
+		if(!served) {
+			fprintf(stderr, "Error: Cannot listen on `%s'.\n", daemonPath);
+			return 6;
+		}
+		return 0;
+	}
+
+	if(manifest) {
+		BATCH batch = { jobs, fps, backend, bufSize, writerFlags, statsFormat, every, duration, checksums, optimize, seekmap, fastStart, events, readLimit, writeLimit };
+		int failed = batch_run(&batch, manifest);
+		print_throttled(readLimit, writeLimit);
+		throttle_close(readLimit);
+		throttle_close(writeLimit);
+		if(failed < 0) {
+			fprintf(stderr, "Error: Cannot read manifest `%s'.\n", manifest);
+			return 255;
+		}
+		return failed ? 7 : 0;
+	}
+
+	if(count == 0 && !watchDir && !source) {
 		help(argv[0]);
 		return 255;
 	}
 
-	if(!jpeg_size(argv[argi], &width, &height)) {
-		fprintf(stderr, "Error: Invalid JPEG file `%s'.\n", argv[argi]);
-		return 1;
+	/* decimate lists before any frame is opened */
+	if(every || duration) {
+		count = frames_select(paths, count, every, duration * fps);
+		for(i = 1; i < streams; i++) {
+			streamCounts[i] = frames_select(streamPaths[i], streamCounts[i], every, duration * fps);
+		}
 	}
 
-	if(outPath && !(out = fopen(outPath, "w+b"))) {
-		fprintf(stderr, "Error: Cannot open output `%s'.\n", outPath);
-		return 2;
-	} else if(!out) {
-		out = stdout;
+	/* variable frame rate, frames are placed by their time */
+	slots = count;
+	if(timeSource >= 0 && count) {
+		double *times = malloc(count * sizeof(double));
+		int known, moved;
+		if(streams > 1) {
+			fprintf(stderr, "Error: Timestamps are supported for single video stream only.\n");
+			return 255;
+		}
+		if(!times || !(repeats = malloc(count * sizeof(int)))) return 255;
+		if((known = frames_times(paths, count, timeSource, times)) < count) {
+			fprintf(stderr, "Error: Cannot get time of frame `%s'.\n", paths[known]);
+			return 1;
+		}
+		if((moved = frames_sort(paths, times, count)) < 0) return 255;
+		if(moved) fprintf(stderr, "Warning: %d frames were out of time order, sorted by time.\n", moved);
+		slots = count = frames_slots(paths, times, count, fps, repeats);
+		for(i = 0; i < count; i++) slots += repeats[i];
+		free(times);
+	}
+
+	if(statsFormat) stats = &statsData;
+
+	if((watchDir || source) && streams > 1) {
+		fprintf(stderr, "Error: Watch and multipart modes support single video stream only.\n");
+		return 255;
 	}
 
-	videoFrameLength = 1.0 / fps;
+	if(watchDir && source) {
+		fprintf(stderr, "Error: Watch and multipart modes cannot be combined.\n");
+		return 255;
+	}
+
+	if(teeCount && (watchDir || source || segmentSize || segmentTime || streams > 1 || timeSource >= 0)) {
+		fprintf(stderr, "Error: Tee outputs support single video stream frame list only.\n");
+		return 255;
+	}
+
+	if(writeLimit && !outPath) {
+		fprintf(stderr, "Error: Write rate limit applies to output file, use -o.\n");
+		return 255;
+	}
+
+	if((watchDir || source || segmentSize || segmentTime || seekmap || fastStart) && !outPath) {
+		fprintf(stderr, "Error: Watch, multipart, segment, seek map and fast start modes need seekable output, use -o.\n");
+		return 255;
+	}
+
+	if(fastStart && (watchDir || source || segmentSize || segmentTime)) {
+		fprintf(stderr, "Error: Fast start needs all frames known up front, it cannot be used with watch, multipart or segments.\n");
+		return 255;
+	}
+
+	if(watchDir || source) {
+		struct sigaction sa;
+		/* watch before existing frames are muxed, so none is missed */
+		if(watchDir && !(watch = watch_open(watchDir))) {
+			fprintf(stderr, "Error: Cannot watch directory `%s'.\n", watchDir);
+			return 6;
+		}
+		if(source && !(multipart = multipart_open(source, maxPart))) {
+			fprintf(stderr, "Error: Cannot open input `%s'.\n", source);
+			return 6;
+		}
+		/* no SA_RESTART, blocked read returns so the file is finished */
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = stop;
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+	}
 
-	if(!(idx = tmpfile())) {
-		fprintf(stderr, "Error: Cannot create temporary index for `%s'.\n", outPath ?: "(stdout)");
-		return 3;
+	start = STATS_START(stats);
+	if(count && !jpeg_size(paths[0], &width, &height)) {
+		fprintf(stderr, "Error: Invalid JPEG file `%s'.\n", paths[0]);
+		return 1;
 	}
-	if(sndPath && !(snd = fopen(sndPath, "rb"))) {
+	stats_add(stats, STATS_PROBE, start, 0);
+
+	mux_init(&mux, fps);
+	mux.stats = stats;
+	mux.streams = streams;
+	mux.checksums = checksums;
+	mux.seekmap = seekmap;
+	mux.path = outPath;
+	mux.fastStart = fastStart;
+	mux.events = events;
+	mux.readLimit = readLimit;
+	mux.writeLimit = writeLimit;
+	/* frames are re-encoded on --jobs threads, all CPUs by default */
+	if(optimize) mux.optimize = jobs ? jobs : -1;
+	streamPaths[0] = paths;
+	streamCounts[0] = count;
+	for(i = 1; i < streams; i++) {
+		start = STATS_START(stats);
+		if(!jpeg_size(streamPaths[i][0], &mux.vids[i].width, &mux.vids[i].height)) {
+			fprintf(stderr, "Error: Invalid JPEG file `%s'.\n", streamPaths[i][0]);
+			return 1;
+		}
+		stats_add(stats, STATS_PROBE, start, 0);
+		mux.vids[i].totalFrames = streamCounts[i];
+		if(streamCounts[i] > count) mux.totalFrames = streamCounts[i];
+	}
+	if(sndPath && !mux_audio(&mux, sndPath)) {
 		fprintf(stderr, "Error: Cannot open input `%s'.\n", sndPath);
 		return 4;
 	}
 
-	if(snd) {
-		if((mp3 = freadmp3header(snd))) {
-			fprintf(stderr, "MP3 `%s' sample rate: %d, bitrate: %d, length: %lu, padding: %d\n", sndPath,
-				mp3samplerate(mp3), mp3bitrate(mp3), mp3framesize(mp3), MPEGPadding(mp3));
-			fseek(snd, 0, SEEK_SET);
-		} else {
-			FOURCC fcc;
-			uint32_t size;
-			uint16_t cbsize;
-			fseek(snd, 0, SEEK_SET);
-			if(freadchunk(&fcc, &size, snd) && fcc == FOURCC_RIFF &&
-			   freadcc(&fcc, snd) && fcc == FOURCC_WAVE &&
-			   freadchunk(&fcc, &size, snd) && fcc == FOURCC_FMT && (sndFmtSize = size) &&
-			   fgetpos(snd, &sndFmtPos) == 0 &&
-			   fread(&wavh, 1, sizeof(wavh), snd) && wavh.format == WAVE_FORMAT_ADPCM &&
-			   fread(&cbsize, 1, sizeof(cbsize), snd) && (cbsize >= sizeof(adpcmh)) &&
-			   fread(&adpcmh, 1, sizeof(adpcmh), snd) && fseek(snd, cbsize - sizeof(adpcmh), SEEK_CUR) == 0) {
-				/* skip all headers until data */
-				while(freadchunk(&fcc, &size, snd) && fcc != FOURCC_DATA) {
-					fseek(snd, size, SEEK_CUR);
-				}
-				if(fcc == FOURCC_DATA) {
-					fprintf(stderr, "WAV `%s' sample rate: %d, bitrate: %d, format: %d, channels: %d, samples per block: %d, block align: %d bytes, data: %d bytes, blocks: %.12g\n", sndPath,
-						wavh.samplesPerSec, wavh.bitsPerSample, wavh.format, wavh.channels, adpcmh.samplesPerBlock,
-						wavh.blockAlign, size, (float)size / (float)wavh.blockAlign);
-					fgetpos(snd, &sndDataPos);
-				}
-			} else {
-				fclose(snd), snd = NULL;
-			}
+	if(segmentSize || segmentTime) {
+		if(!(segment = segment_open(&mux, outPath, segmentSize, segmentTime, retain, bufSize, writerFlags))) {
+			fprintf(stderr, "Error: Cannot open output `%s'.\n", outPath);
+			return 2;
 		}
+		out = segment_file(segment);
+	} else if(outPath && !(out = writer_file(writer = writer_open(outPath, bufSize, writerFlags)))) {
+		fprintf(stderr, "Error: Cannot open output `%s'.\n", outPath);
+		return 2;
+	} else if(!out) {
+		out = stdout;
 	}
+	writer_throttle(writer, writeLimit);
+
+	if(count) {
+		mux.vids[0].width = width;
+		mux.vids[0].height = height;
+		mux.vids[0].totalFrames = slots;
+		if(slots > mux.totalFrames) mux.totalFrames = slots;
+		fprintf(stderr, "AVI `%s' %dx%d %d frames\n", outPath, width, height, slots);
+		for(i = 1; i < streams; i++) {
+			fprintf(stderr, "AVI `%s' stream %d %dx%d %d frames\n", outPath, i, mux.vids[i].width, mux.vids[i].height, streamCounts[i]);
+		}
+		if(!mux_begin(&mux, out)) {
+			fprintf(stderr, "Error: Cannot create temporary index for `%s'.\n", outPath ?: "(stdout)");
+			return 3;
+		}
 
-	fgetpos(out, &riffPos);
-	fwritechunk(FOURCC_RIFF, 0, out);
-	riffSize = fwritecc(FOURCC_AVI, out);
-
-		fgetpos(out, &hdrlPos);
-		riffSize += fwritechunk(FOURCC_LIST, 0, out);
-		hdrlSize = fwritecc(FOURCC_HDRL, out);
-
-		hdrlSize += fwritechunk(FOURCC_AVIH, sizeof(avih), out);
-		memset(&avih, 0, sizeof(avih));
-		avih.microSecPerFrame = 1000000 / fps;
-		avih.maxBytesPerSec = 45000;
-		avih.flags = AVIF_HASINDEX | AVIF_ISINTERLEAVED | AVIF_TRUSTCKTYPE;
-		avih.totalFrames = argc - argi;
-		avih.streams = snd ? 2 : 1;
-		avih.width = width;
-		avih.height = height;
-		avih.suggestedBufferSize = 1024*1024;
-		hdrlSize += fwrite(&avih, 1, sizeof(avih), out);
-
-		fprintf(stderr, "AVI `%s' %dx%d %d frames\n", outPath, avih.width, avih.height, avih.totalFrames);
-
-			fgetpos(out, &strlPos);
-			hdrlSize += fwritechunk(FOURCC_LIST, 0, out);
-			strlSize = fwritecc(FOURCC_STRL, out);
-
-				strlSize += fwritechunk(FOURCC_STRH, sizeof(strh), out);
-				memset(&strh, 0, sizeof(strh));
-				strh.type = FOURCC_VIDS;
-				strh.handler = CC("MJPG");
-				strh.scale   = 1;
-				strh.rate    = fps;
-				strh.quality = (uint32_t)-1;
-				strh.length  = avih.totalFrames;
-				strh.suggestedBufferSize = avih.suggestedBufferSize;
-				strh.frame.right  = avih.width;
-				strh.frame.bottom = avih.height;
-				strlSize += fwrite(&strh, 1, sizeof(strh), out);
-
-				strlSize += fwritechunk(FOURCC_STRF, sizeof(bmph), out);
-				memset(&bmph, 0, sizeof(bmph));
-				bmph.size     = sizeof(bmph);
-				bmph.width    = avih.width;
-				bmph.height   = avih.height;
-				bmph.planes   = 1;
-				bmph.bitCount = 24;
-				bmph.imgSize  = bmph.width * bmph.height * bmph.bitCount / 8;
-				bmph.compression = CC("MJPG");
-				strlSize += fwrite(&bmph, 1, sizeof(bmph), out);
-
-				strlSize += fwritechunk(FOURCC_VPRP, sizeof(vprp), out);
-				memset(&vprp, 0, sizeof(vprp));
-				vprp.verticalRefreshRate = fps;
-				vprp.hTotalInT           = avih.width;
-				vprp.vTotalInLines       = avih.height;
-				vprp.frameAspectRatio    = ASPECT_3_2;
-				vprp.frameWidthInPixels  = avih.width;
-				vprp.frameHeightInLines  = avih.height;
-				vprp.fieldsPerFrame      = 1;
-				vprp.field.compressedBMHeight = avih.height;
-				vprp.field.compressedBMWidth  = avih.width;
-				vprp.field.validBMHeight      = avih.height;
-				vprp.field.validBMWidth       = avih.width;
-				strlSize += fwrite(&vprp, 1, sizeof(vprp), out);
-
-			fupdate(out, &strlPos, strlSize);
-			hdrlSize += strlSize;
-
-			if(snd) {
-				fgetpos(out, &strlPos);
-				hdrlSize += fwritechunk(FOURCC_LIST, 0, out);
-				strlSize = fwritecc(FOURCC_STRL, out);
-
-				if(mp3) {
-					strlSize += fwritechunk(FOURCC_STRH, sizeof(strh), out);
-					memset(&strh, 0, sizeof(strh));
-					strh.type = FOURCC_AUDS;
-					strh.scale = 1;
-					strh.rate = mp3bitrate(mp3) * 1000 / 8;
-					strh.quality = 10000;
-					strh.initialFrames = 1;
-					strh.length = avih.totalFrames * videoFrameLength / mp3framelength(mp3);
-					strh.suggestedBufferSize = 1024*1024;
-					strh.sampleSize = 1;
-					strlSize += fwrite(&strh, 1, sizeof(strh), out);
-
-					strlSize += fwritechunk(FOURCC_STRF, sizeof(mp3h), out);
-					memset(&mp3h, 0, sizeof(mp3h));
-					mp3h.wavh.format = WAVE_FORMAT_MPEGLAYER3;
-					mp3h.wavh.channels = MPEGChannels(mp3) == MPEGChannelsMono ? 1 : 2;
-					mp3h.wavh.samplesPerSec = mp3samplerate(mp3);
-					mp3h.wavh.avgBytesPerSec = strh.rate;
-					mp3h.wavh.blockAlign = 1;
-					mp3h.size = sizeof(mp3h) - sizeof(mp3h.wavh) - sizeof(mp3h.size);
-					mp3h.id = MPEGLAYER3_ID_MPEG;
-					mp3h.flags = MPEGLAYER3_FLAG_PADDING_ISO;
-					strlSize += fwrite(&mp3h, 1, sizeof(mp3h), out);
-				} else {
-					strlSize += fwritechunk(FOURCC_STRH, sizeof(strh), out);
-					memset(&strh, 0, sizeof(strh));
-					strh.type = FOURCC_AUDS;
-					strh.scale = 253;
-					strh.rate = wavh.samplesPerSec / wavh.bitsPerSample;
-					strh.quality = (uint32_t)-1;
-					strh.initialFrames = 0;
-					strh.length = avih.totalFrames * wavh.samplesPerSec / fps / adpcmh.samplesPerBlock;
-					strh.suggestedBufferSize = 12288 /* ??? FFmpeg tells so */;
-					strh.sampleSize = wavh.blockAlign;
-					strlSize += fwrite(&strh, 1, sizeof(strh), out);
-
-					fsetpos(snd, &sndFmtPos);
-					strlSize += fwritechunk(FOURCC_STRF, sndFmtSize, out);
-					strlSize += fcopy(snd, out, sndFmtSize);
-					fsetpos(snd, &sndDataPos);
+		if(prealloc && writer) {
+			/* planning pass, stat every frame to presize the output */
+			uint64_t frameBytes = 0;
+			struct stat st;
+			int frames = 0, j;
+			for(i = 0; i < streams; i++) {
+				for(j = 0; j < streamCounts[i]; j++) {
+					if(!stat(streamPaths[i][j], &st)) frameBytes += st.st_size + (st.st_size % 2);
 				}
-
-				fupdate(out, &strlPos, strlSize);
-				hdrlSize += strlSize;
+				frames += streamCounts[i];
 			}
+			writer_reserve(writer, mux_estimate(&mux, frames, frameBytes));
+		}
 
-		fupdate(out, &hdrlPos, hdrlSize);
-		riffSize += hdrlSize;
-
-		fgetpos(out, &moviPos);
-		riffSize += fwritechunk(FOURCC_LIST, 0, out);
-		moviSize = fwritecc(FOURCC_MOVI, out);
-
-		while(1) {
-			if(frame + argi >= argc) break;
-
-			while(snd && audio < video + videoFrameLength * 2) {
-				if(mp3) {
-					/* read next mp3 frame */
-					if(!(mp3 = freadmp3header(snd))) {
-						fseek(snd, 0, SEEK_SET);
-						mp3 = freadmp3header(snd);
-					}
-					size_t bufSize = mp3framesize(mp3) - sizeof(mp3);
-					uint32_t buf[bufSize + 1];
-					buf[bufSize] = 0;
-					if(fread(buf, 1, bufSize, snd) == bufSize) {
-						IDX1 idx1 = { CC("01wb"), 0, moviSize, bufSize + sizeof(mp3) };
-						fwrite(&idx1, 1, sizeof(idx1), idx);
-						moviSize += fwritechunk(CC("01wb"), bufSize + sizeof(mp3), out);
-						moviSize += fwritemp3header(out, mp3);
-						moviSize += fwrite(buf, 1, bufSize + (bufSize % 2), out);
-					}
-					audio += mp3framelength(mp3);
-				} else {
-					/* read next wav chunk */
-					size_t copied;
-					IDX1 idx1 = { CC("01wb"), 0, moviSize, wavh.blockAlign};
-					fwrite(&idx1, 1, sizeof(idx1), idx);
-					moviSize += fwritechunk(CC("01wb"), wavh.blockAlign, out);
-					moviSize += copied = fcopy(snd, out, wavh.blockAlign);
-					if(copied == 0) {
-						fsetpos(snd, &sndDataPos);
-						moviSize += fcopy(snd, out, wavh.blockAlign);
-					}
-					audio += (double)adpcmh.samplesPerBlock / (double)wavh.samplesPerSec;
+		for(i = 0; i < teeCount; i++) {
+			TEE *t = &tees[i];
+			WRITER *w;
+			mux_init(&t->mux, t->fps ? t->fps : fps);
+			t->mux.checksums = checksums;
+			t->mux.seekmap = seekmap;
+			t->mux.path = t->path;
+			t->mux.fastStart = fastStart;
+			t->mux.events = events;
+			t->mux.writeLimit = writeLimit;
+			t->mux.vids[0].width = width;
+			t->mux.vids[0].height = height;
+			t->mux.totalFrames = t->mux.vids[0].totalFrames = (count + t->every - 1) / t->every;
+			/* soundtrack is parsed once, each output reads it on its own */
+			if(sndPath && t->audio) {
+				FILE *snd = fopen(sndPath, "rb");
+				if(!snd) {
+					fprintf(stderr, "Error: Cannot open input `%s'.\n", sndPath);
+					return 4;
 				}
+				mux_audio_share(&t->mux, &mux, snd);
+			}
+			writer_throttle(w = writer_open(t->path, bufSize, writerFlags), writeLimit);
+			if(!(t->out = writer_file(w))) {
+				fprintf(stderr, "Error: Cannot open output `%s'.\n", t->path);
+				return 2;
 			}
+			fprintf(stderr, "AVI `%s' %dx%d %d frames\n", t->path, width, height, t->mux.totalFrames);
+			if(!mux_begin(&t->mux, t->out)) {
+				fprintf(stderr, "Error: Cannot create temporary index for `%s'.\n", t->path);
+				return 3;
+			}
+		}
 
-			in = fopen(argv[frame + argi], "rb");
-			if(!in) {
-				moviSize += fwritechunk(CC("00dc"), 0, out);
-			} else {
-				IDX1 idx1 = { CC("00dc"), 0, moviSize, 0 };
-				uint32_t buf[1024];
-				fseek(in, 0, SEEK_END);
-				idx1.size = ftell(in);
-				fwrite(&idx1, 1, sizeof(idx1), idx);
-				moviSize += fwritechunk(CC("00dc"), idx1.size, out);
-				fseek(in, 0, SEEK_SET);
-				while(1) {
-					read = fread(buf, 1, sizeof(buf), in);
-					if(read > 0) {
-						/* NOTE: Little trick here, ensure we write 2 byte padded data */
-						moviSize += fwrite(buf, 1, read + (read % 2), out);
-					}
-					if(read < sizeof(buf)) break;
+		if(teeCount) {
+			MUX *muxes[MAX_TEES + 1] = { &mux };
+			int strides[MAX_TEES + 1] = { 1 };
+			for(i = 0; i < teeCount; i++) {
+				muxes[i + 1] = &tees[i].mux;
+				strides[i + 1] = tees[i].every;
+			}
+			if(!mux_tee(muxes, strides, teeCount + 1, paths, count, backend)) return 5;
+		} else if(repeats) {
+			if(!mux_timed(&mux, paths, repeats, count, backend)) return mux.out ? 5 : rollover_failed(segment);
+		} else if(!mux_lists(&mux, (const char *const *const *)streamPaths, streamCounts, backend)) {
+			return mux.out ? 5 : rollover_failed(segment);
+		}
+	}
+
+	if(watch) {
+		uint64_t next = stats_now() + refresh * 1000000000ull;
+		int ret;
+		fprintf(stderr, "Watching `%s', Ctrl+C to finish `%s'\n", watchDir, outPath);
+		while(!stopped) {
+			const char *path;
+			int64_t left = (int64_t)(next - stats_now()) / 1000000;
+			if((ret = watch_next(watch, mux.out ? (left > 0 ? left : 0) : -1, &path)) < 0) break;
+			if(ret && !mux.out) {
+				/* first frame decides dimensions */
+				start = STATS_START(stats);
+				if(!jpeg_size(path, &width, &height)) {
+					fprintf(stderr, "Warning: Invalid JPEG file `%s', ignoring.\n", path);
+					continue;
 				}
+				stats_add(stats, STATS_PROBE, start, 0);
+				if(!begin_live(&mux, out, outPath, width, height)) return 3;
 			}
-			video += videoFrameLength;
-			frame ++;
-			fclose(in);
+			if(ret && !mux_paths(&mux, &path, 1, FRAMES_STDIO)) return mux.out ? 5 : rollover_failed(segment);
+			/* make file playable while being written */
+			if(mux.out && stats_now() >= next) next = refresh_output(&mux, segment, writer, refresh);
 		}
+		watch_close(watch);
+		fprintf(stderr, "AVI `%s' %d frames\n", outPath, mux.frames);
+	}
 
-		fupdate(out, &moviPos, moviSize);
-		riffSize += moviSize;
-
-		/* rewrite index */
-		if(idx) {
-			uint32_t buf[1024];
-			moviSize += fwritechunk(FOURCC_IDX1, ftell(idx), out);
-			fseek(idx, 0, SEEK_SET);
-			while(1) {
-				read = fread(buf, 1, sizeof(buf), idx);
-				if(read > 0) {
-					/* NOTE: Little trick here, ensure we write 2 byte padded data */
-					riffSize += fwrite(buf, 1, read + (read % 2), out);
+	if(multipart) {
+		uint64_t next = stats_now() + refresh * 1000000000ull, frameStart;
+		const void *data;
+		size_t size, optSize, optCap = 0;
+		uint8_t *opt = NULL;
+		int ret;
+		fprintf(stderr, "Reading `%s', Ctrl+C to finish `%s'\n", source, outPath);
+		/* parts go straight from read buffer to output, next part is read
+		 * only after this one is written */
+		while(!stopped) {
+			frameStart = start = STATS_START(stats);
+			if((ret = multipart_next(multipart, &data, &size)) <= 0) {
+				if(ret < 0) fprintf(stderr, "Warning: Cannot read input `%s', finishing.\n", source);
+				break;
+			}
+			stats_add(stats, STATS_FRAME_READ, start, size);
+			if(!mux.out) {
+				if(!jpeg_size_data(data, size, &width, &height)) {
+					fprintf(stderr, "Warning: Invalid JPEG part, ignoring.\n");
+					continue;
 				}
-				if(read < sizeof(buf)) break;
+				if(!begin_live(&mux, out, outPath, width, height)) return 3;
 			}
+			if(optimize) {
+				/* live parts come one by one, re-encoded in place */
+				mux.optimizeIn += size;
+				if((optSize = jpeg_optimize(data, size, &opt, &optCap))) data = opt, size = optSize;
+				mux.optimizeOut += size;
+			}
+			if(!mux_frame(&mux, data, size)) return rollover_failed(segment);
+			stats_frame(stats, frameStart);
+			if(stats_now() >= next) next = refresh_output(&mux, segment, writer, refresh);
 		}
+		free(opt);
+		multipart_close(multipart);
+		fprintf(stderr, "AVI `%s' %d frames\n", outPath, mux.frames);
+	}
+
+	if(mux.out) mux_end(&mux);
+
+	if(segment) segment_close(segment);
+	else if(out && out != stdout) fclose(out);
 
-	fupdate(out, &riffPos, riffSize);
+	for(i = 0; i < teeCount; i++) {
+		if(tees[i].mux.out) mux_end(&tees[i].mux);
+		if(tees[i].out) fclose(tees[i].out);
+		free(tees[i].path);
+	}
+
+	if(optimize && mux.optimizeIn) {
+		fprintf(stderr, "Huffman optimization %llu -> %llu frame bytes (%.1f%% smaller)\n",
+			(unsigned long long)mux.optimizeIn, (unsigned long long)mux.optimizeOut,
+			100.0 - 100.0 * mux.optimizeOut / mux.optimizeIn);
+	}
+	if(events) fprintf(stderr, "Activity events %u\n", mux.eventTotal);
+	print_throttled(readLimit, writeLimit);
+	throttle_close(readLimit);
+	throttle_close(writeLimit);
 
-	if(out && out != stdout) fclose(out);
-	if(idx) fclose(idx);
-	if(snd) fclose(snd);
+	if(stats) stats_print(stats, stderr, statsFormat);
 
 	return 0;
-}
\ No newline at end of file
+}
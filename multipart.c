@@ -0,0 +1,373 @@
+/*
+ * multipart.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "multipart.h"
+
+#define MULTIPART_BUFSIZE (1024*1024) /* initial buffer, grows up to maxPart */
+#define MULTIPART_BOUNDARY 128
+
+struct MULTIPART {
+	int      fd;
+	uint8_t *buf;
+	size_t   cap, max;
+	size_t   at, len;   /* unconsumed data is buf[at..len) */
+	int      eof;
+	char     boundary[MULTIPART_BOUNDARY]; /* without leading dashes */
+	size_t   boundaryLen;
+};
+
+/* Reads more data behind unconsumed part, growing buffer when full.
+ * Returns bytes read, 0 at end of stream or on signal, -1 on error, -2 when
+ * buffer is at its limit. */
+static ssize_t mp_fill(MULTIPART *mp)
+{
+	ssize_t n;
+	if(mp->eof) return 0;
+	if(mp->at) {
+		memmove(mp->buf, mp->buf + mp->at, mp->len - mp->at);
+		mp->len -= mp->at;
+		mp->at = 0;
+	}
+	if(mp->len == mp->cap) {
+		size_t cap = mp->cap * 2 < mp->max ? mp->cap * 2 : mp->max;
+		uint8_t *grown;
+		if(cap <= mp->cap || !(grown = realloc(mp->buf, cap))) return -2;
+		mp->buf = grown;
+		mp->cap = cap;
+	}
+	if((n = read(mp->fd, mp->buf + mp->len, mp->cap - mp->len)) > 0) {
+		mp->len += n;
+	} else if(n == 0 || errno == EINTR) {
+		mp->eof = 1;
+		n = 0;
+	}
+	return n;
+}
+
+/* Next line without line end, consumed. Returns 1 with line, 0 at end of
+ * stream, -1 on error. Line longer than buffer limit is dropped. */
+static int mp_line(MULTIPART *mp, const char **line, size_t *len)
+{
+	size_t scanned = 0;
+	for(;;) {
+		uint8_t *start = mp->buf + mp->at, *end;
+		ssize_t n;
+		if((end = memchr(start + scanned, '\n', mp->len - mp->at - scanned))) {
+			mp->at += end - start + 1;
+			if(end > start && end[-1] == '\r') end--;
+			*line = (const char *)start;
+			*len = end - start;
+			return 1;
+		}
+		scanned = mp->len - mp->at;
+		if((n = mp_fill(mp)) == -2) {
+			/* binary garbage, keep looking for line end */
+			mp->at = mp->len;
+			scanned = 0;
+		} else if(n <= 0) {
+			return n;
+		}
+	}
+}
+
+/* Returns 1 for part delimiter, 2 for closing delimiter, 0 otherwise. */
+static int mp_delimiter(MULTIPART *mp, const char *line, size_t len)
+{
+	size_t dashes = 0;
+	while(dashes < len && line[dashes] == '-') dashes++;
+	if(dashes < 2) return 0;
+	line += dashes, len -= dashes;
+	if(!mp->boundaryLen) {
+		/* no HTTP header, first delimiter line defines boundary */
+		if(!len || len >= sizeof(mp->boundary)) return 0;
+		memcpy(mp->boundary, line, len);
+		mp->boundaryLen = len;
+		return 1;
+	}
+	if(len < mp->boundaryLen || memcmp(line, mp->boundary, mp->boundaryLen)) return 0;
+	line += mp->boundaryLen, len -= mp->boundaryLen;
+	if(len >= 2 && line[0] == '-' && line[1] == '-') return 2;
+	while(len && (*line == ' ' || *line == '\t')) line++, len--;
+	return len ? 0 : 1;
+}
+
+/* Takes boundary from Content-Type header value, leading dashes stripped,
+ * as some cameras put them in declared boundary and some do not. */
+static void mp_boundary(MULTIPART *mp, const char *value, size_t len)
+{
+	const char *p = memmem(value, len, "boundary=", 9), *end;
+	if(!p) return;
+	p += 9;
+	end = value + len;
+	if(p < end && *p == '"') {
+		const char *q;
+		p++;
+		q = memchr(p, '"', end - p);
+		if(q) end = q;
+	} else {
+		const char *q = p;
+		while(q < end && *q != ';' && *q != ' ' && *q != '\t') q++;
+		end = q;
+	}
+	while(p < end && *p == '-') p++;
+	if(p < end && (size_t)(end - p) < sizeof(mp->boundary)) {
+		memcpy(mp->boundary, p, end - p);
+		mp->boundaryLen = end - p;
+	}
+}
+
+static int mp_tcp(const char *host, const char *port)
+{
+	struct addrinfo hints, *res, *ai;
+	int fd = -1;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	if(getaddrinfo(host, port, &hints, &res)) return -1;
+	for(ai = res; ai && fd < 0; ai = ai->ai_next) {
+		if((fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol)) >= 0 &&
+		   connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+			close(fd), fd = -1;
+		}
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+/* Connects to http://host[:port][/path] and sends GET request, response
+ * header is read by multipart_open. */
+static int mp_http(const char *url)
+{
+	char host[256], port[16] = "80";
+	const char *path = strchr(url, '/'), *colon;
+	size_t hostLen;
+	int fd;
+	if(!path) path = url + strlen(url);
+	colon = memchr(url, ':', path - url);
+	hostLen = (colon ? colon : path) - url;
+	if(!hostLen || hostLen >= sizeof(host)) return -1;
+	memcpy(host, url, hostLen);
+	host[hostLen] = 0;
+	if(colon) {
+		if((size_t)(path - colon - 1) >= sizeof(port) || path == colon + 1) return -1;
+		memcpy(port, colon + 1, path - colon - 1);
+		port[path - colon - 1] = 0;
+	}
+	if((fd = mp_tcp(host, port)) < 0) return -1;
+	if(dprintf(fd, "GET %s HTTP/1.0\r\nHost: %.*s\r\nUser-Agent: mjpeg\r\n\r\n",
+	           *path ? path : "/", (int)(path - url), url) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int mp_connect(const char *source)
+{
+	int fd = -1;
+	if(!strncmp(source, "unix:", 5)) {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if(strlen(source + 5) >= sizeof(addr.sun_path)) return -1;
+		strcpy(addr.sun_path, source + 5);
+		if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) >= 0 &&
+		   connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			close(fd), fd = -1;
+		}
+	} else if(!strncmp(source, "tcp:", 4)) {
+		char host[256] = "127.0.0.1";
+		const char *port = strrchr(source + 4, ':');
+		if(port) {
+			if((size_t)(port - source - 4) >= sizeof(host)) return -1;
+			memcpy(host, source + 4, port - source - 4);
+			host[port++ - source - 4] = 0;
+		} else {
+			port = source + 4;
+		}
+		fd = mp_tcp(host, port);
+	} else if(!strncmp(source, "http://", 7)) {
+		fd = mp_http(source + 7);
+	} else if(!strcmp(source, "-")) {
+		fd = dup(0);
+	} else {
+		fd = open(source, O_RDONLY | O_CLOEXEC);
+	}
+	return fd;
+}
+
+MULTIPART *multipart_open(const char *source, size_t maxPart)
+{
+	MULTIPART *mp = calloc(1, sizeof(MULTIPART));
+	const char *line;
+	size_t len;
+	if(!mp) return NULL;
+	mp->max = maxPart ? maxPart : MULTIPART_MAXPART;
+	mp->cap = mp->max < MULTIPART_BUFSIZE ? mp->max : MULTIPART_BUFSIZE;
+	if(!(mp->buf = malloc(mp->cap)) || (mp->fd = mp_connect(source)) < 0) {
+		free(mp->buf);
+		free(mp);
+		return NULL;
+	}
+	/* HTTP response header declares boundary, capture may start without it */
+	while(mp->len < 5 && mp_fill(mp) > 0);
+	if(mp->len >= 5 && !memcmp(mp->buf, "HTTP/", 5)) {
+		int status = 0;
+		if(mp_line(mp, &line, &len) > 0) {
+			const char *code = memchr(line, ' ', len);
+			if(code) status = atoi(code + 1);
+		}
+		if(status != 200) {
+			fprintf(stderr, "Error: Stream `%s' answered with HTTP status %d.\n", source, status);
+			multipart_close(mp);
+			return NULL;
+		}
+		while(mp_line(mp, &line, &len) > 0 && len) {
+			if(len > 13 && !strncasecmp(line, "Content-Type:", 13)) mp_boundary(mp, line + 13, len - 13);
+		}
+	}
+	return mp;
+}
+
+/* Skips rest of part longer than buffer limit, leaves next delimiter
+ * unconsumed. Returns 0 at end of stream. */
+static int mp_skip(MULTIPART *mp, size_t length)
+{
+	if(length) {
+		/* known length, drop it as it comes */
+		for(;;) {
+			size_t have = mp->len - mp->at;
+			if(have >= length) {
+				mp->at += length;
+				return 1;
+			}
+			length -= have;
+			mp->at = mp->len;
+			if(mp_fill(mp) <= 0) return 0;
+		}
+	}
+	/* drop all but possible start of delimiter line */
+	mp->at = mp->len > mp->boundaryLen + 4 ? mp->len - mp->boundaryLen - 4 : mp->at;
+	return 1;
+}
+
+int multipart_next(MULTIPART *mp, const void **data, size_t *size)
+{
+	for(;;) {
+		const char *line;
+		size_t len, length = 0, scanned = 0;
+		uint8_t *start;
+		int ret, skip = 0;
+		ssize_t n = 0;
+
+		/* delimiter, anything before it is resynchronized over */
+		while((ret = mp_line(mp, &line, &len)) > 0 && !(ret = mp_delimiter(mp, line, len)));
+		if(ret != 1) return ret < 0 ? -1 : 0;
+		while((ret = mp_line(mp, &line, &len)) > 0 && len) {
+			if(len > 15 && !strncasecmp(line, "Content-Length:", 15)) length = strtoul(line + 15, NULL, 10);
+		}
+		if(ret <= 0) return ret;
+
+		if(length) {
+			/* fast path, no need to look at the data */
+			while(mp->len - mp->at < length && (n = mp_fill(mp)) > 0);
+			if(mp->len - mp->at < length) {
+				if(mp->eof) return 0;
+				if(n == -1) return -1;
+				fprintf(stderr, "Warning: Skipping %lu bytes part exceeding buffer limit.\n", (unsigned long)length);
+				if(!mp_skip(mp, length)) return 0;
+				continue;
+			}
+			start = mp->buf + mp->at;
+			mp->at += length;
+		} else {
+			/* scan for next delimiter line */
+			uint8_t *found = NULL;
+			for(;;) {
+				uint8_t *p = mp->buf + mp->at + scanned, *end = mp->buf + mp->len;
+				while((p = memmem(p, end - p, mp->boundary, mp->boundaryLen))) {
+					uint8_t *q = p;
+					while(q > mp->buf + mp->at && q[-1] == '-') q--;
+					if(p - q >= 2 && q > mp->buf + mp->at && q[-1] == '\n') {
+						found = q;
+						break;
+					}
+					p++;
+				}
+				if(found) break;
+				/* boundary may be cut by buffer end */
+				scanned = mp->len - mp->at > mp->boundaryLen + 4 ? mp->len - mp->at - mp->boundaryLen - 4 : 0;
+				if((n = mp_fill(mp)) == -2) {
+					if(!skip++) fprintf(stderr, "Warning: Skipping part exceeding buffer limit.\n");
+					mp_skip(mp, 0);
+					scanned = 0;
+				} else if(n == -1) {
+					return -1;
+				} else if(n == 0) {
+					break;
+				}
+			}
+			/* part not followed by delimiter is cut off */
+			if(!found) return 0;
+			if(skip) {
+				mp->at = found - mp->buf;
+				continue;
+			}
+			start = mp->buf + mp->at;
+			length = found - start;
+			/* line end before delimiter belongs to it */
+			if(length && start[length - 1] == '\n') length--;
+			if(length && start[length - 1] == '\r') length--;
+			mp->at = found - mp->buf;
+		}
+
+		if(length < 2 || start[0] != 0xFF || start[1] != 0xD8) {
+			fprintf(stderr, "Warning: Skipping %lu bytes part which is not JPEG.\n", (unsigned long)length);
+			continue;
+		}
+		*data = start;
+		*size = length;
+		return 1;
+	}
+}
+
+void multipart_close(MULTIPART *mp)
+{
+	close(mp->fd);
+	free(mp->buf);
+	free(mp);
+}
@@ -0,0 +1,44 @@
+/*
+ * multipart.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define MULTIPART_MAXPART (16*1024*1024) /* default limit of single part */
+
+typedef struct MULTIPART MULTIPART;
+
+/* Opens multipart/x-mixed-replace MJPEG stream (e.g. HTTP response of IP
+ * camera) from file or FIFO path, "-" for standard input, unix:path for
+ * Unix domain socket or tcp:[host:]port for TCP socket on localhost, all of
+ * which must push the stream by themselves, or http://host[:port]/path
+ * which is requested with GET. Parts are read into single buffer growing up
+ * to maxPart bytes, larger parts are skipped. Returns NULL when source
+ * cannot be opened or HTTP response status is not 200. */
+MULTIPART *multipart_open(const char *source, size_t maxPart);
+/* Reads next JPEG part, using its Content-Length when present, otherwise
+ * scanning for boundary. Returns 1 with data valid until next call, 0 at
+ * end of stream or on signal, -1 on read error. Stream is read only when
+ * next part is requested, so slow consumer holds the sender back. */
+int multipart_next(MULTIPART *mp, const void **data, size_t *size);
+void multipart_close(MULTIPART *mp);
@@ -0,0 +1,811 @@
+/*
+ * mux.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "riff.h"
+#include "mp3.h"
+#include "throttle.h"
+#include "frames.h"
+#include "stats.h"
+#include "probes.h"
+#include "crc32c.h"
+#include "seekmap.h"
+#include "activity.h"
+#include "mux.h"
+
+/* Patches chunk size accounting time spent in header updates. */
+static int update(MUX *m, fpos_t *pos, uint32_t value)
+{
+	uint64_t start = STATS_START(m->stats);
+	int ret = fupdate(m->out, pos, value);
+	PROBE_UPDATE(FPOS_OFFSET(pos), value);
+	stats_add(m->stats, STATS_UPDATE, start, 0);
+	return ret;
+}
+
+/* Checksum goes to `crcs' chunk in same order as index entries. */
+static void index_append(MUX *m, FOURCC id, uint32_t size, uint32_t crc)
+{
+	IDX1 idx1 = { id, 0, m->moviSize, size };
+	fwrite(&idx1, 1, sizeof(idx1), m->idx);
+	if(m->crc) fwrite(&crc, 1, sizeof(crc), m->crc);
+	PROBE_INDEX_APPEND(idx1.id, idx1.offset, idx1.size);
+}
+
+void mux_init(MUX *m, int fps)
+{
+	memset(m, 0, sizeof(*m));
+	m->fps = fps;
+	m->streams = 1;
+	m->videoFrameLength = 1.0 / fps;
+}
+
+int mux_audio(MUX *m, const char *path)
+{
+	FILE *snd;
+	if(!(snd = fopen(path, "rb"))) return 0;
+	mux_audio_stream(m, snd, path);
+	return 1;
+}
+
+int mux_audio_stream(MUX *m, FILE *snd, const char *path)
+{
+	uint64_t start = STATS_START(m->stats);
+	m->sndPath = path;
+
+	if((m->mp3 = freadmp3header(snd))) {
+		fprintf(stderr, "MP3 `%s' sample rate: %d, bitrate: %d, length: %lu, padding: %d\n", path,
+			mp3samplerate(m->mp3), mp3bitrate(m->mp3), mp3framesize(m->mp3), MPEGPadding(m->mp3));
+		fseek(snd, 0, SEEK_SET);
+		m->snd = snd;
+	} else {
+		FOURCC fcc;
+		uint32_t size;
+		uint16_t cbsize;
+		fseek(snd, 0, SEEK_SET);
+		if(freadchunk(&fcc, &size, snd) && fcc == FOURCC_RIFF &&
+		   freadcc(&fcc, snd) && fcc == FOURCC_WAVE &&
+		   freadchunk(&fcc, &size, snd) && fcc == FOURCC_FMT && (m->sndFmtSize = size) &&
+		   (m->sndFmtPos = ftell(snd)) >= 0 &&
+		   fread(&m->wavh, 1, sizeof(m->wavh), snd) && m->wavh.format == WAVE_FORMAT_ADPCM &&
+		   fread(&cbsize, 1, sizeof(cbsize), snd) && (cbsize >= sizeof(m->adpcmh)) &&
+		   fread(&m->adpcmh, 1, sizeof(m->adpcmh), snd) && fseek(snd, cbsize - sizeof(m->adpcmh), SEEK_CUR) == 0) {
+			/* skip all headers until data */
+			while(freadchunk(&fcc, &size, snd) && fcc != FOURCC_DATA) {
+				fseek(snd, size, SEEK_CUR);
+			}
+			if(fcc == FOURCC_DATA) {
+				fprintf(stderr, "WAV `%s' sample rate: %d, bitrate: %d, format: %d, channels: %d, samples per block: %d, block align: %d bytes, data: %d bytes, blocks: %.12g\n", path,
+					m->wavh.samplesPerSec, m->wavh.bitsPerSample, m->wavh.format, m->wavh.channels, m->adpcmh.samplesPerBlock,
+					m->wavh.blockAlign, size, (float)size / (float)m->wavh.blockAlign);
+				m->sndDataPos = ftell(snd);
+				m->snd = snd;
+			}
+		}
+		if(!m->snd) {
+			fprintf(stderr, "Warning: Unsupported audio `%s', ignoring.\n", path);
+			fclose(snd);
+		}
+	}
+	stats_add(m->stats, STATS_AUDIO_SETUP, start, 0);
+	return m->snd != NULL;
+}
+
+void mux_audio_share(MUX *m, const MUX *from, FILE *snd)
+{
+	m->sndPath    = from->sndPath;
+	m->mp3        = from->mp3;
+	m->wavh       = from->wavh;
+	m->adpcmh     = from->adpcmh;
+	m->sndFmtPos  = from->sndFmtPos;
+	m->sndDataPos = from->sndDataPos;
+	m->sndFmtSize = from->sndFmtSize;
+	if((m->snd = from->snd ? snd : NULL)) fseek(snd, m->mp3 ? 0 : m->sndDataPos, SEEK_SET);
+	else if(snd) fclose(snd);
+}
+
+/* Audio chunks interleaved with given number of frames. */
+static uint64_t mux_audio_chunks(MUX *m, uint32_t frames)
+{
+	double duration = (frames + 2) * m->videoFrameLength;
+	if(!m->snd) return 0;
+	if(m->mp3) return (uint64_t)(duration / mp3framelength(m->mp3) + 1);
+	return (uint64_t)(duration * m->wavh.samplesPerSec / m->adpcmh.samplesPerBlock + 1);
+}
+
+/* Writes `indx' super index of a stream, patched by mux_fast_start. */
+static size_t mux_indx(MUX *m, int stream, FOURCC id, FILE *out)
+{
+	INDX indx;
+	size_t size;
+	memset(&indx, 0, sizeof(indx));
+	indx.longsPerEntry = 4;
+	indx.indexType = AVI_INDEX_OF_INDEXES;
+	indx.entriesInUse = 1;
+	indx.chunkId = id;
+	size = fwritechunk(FOURCC_INDX, sizeof(indx), out);
+	fgetpos(out, &m->indxPos[stream]);
+	return size + fwrite(&indx, 1, sizeof(indx), out);
+}
+
+/* Reserves empty `ix##' chunk for planned number of entries. */
+static size_t mux_ix(MUX *m, int stream, uint32_t entries, FILE *out)
+{
+	static const uint8_t zero[4096];
+	size_t size = sizeof(IXHDR) + (size_t)entries * sizeof(IXENTRY), left, wrote, n;
+	m->ixEntries[stream] = entries;
+	m->ixOffset[stream] = ftell(out);
+	wrote = fwritechunk(CCIX(stream), size, out);
+	fgetpos(out, &m->ixPos[stream]);
+	for(left = size; left > 0; left -= n) {
+		n = left < sizeof(zero) ? left : sizeof(zero);
+		wrote += fwrite(zero, 1, n, out);
+	}
+	return wrote;
+}
+
+/* Header fields that depend on number of frames written so far. */
+static void mux_counts(MUX *m, AVIH *avih, STRH *auds)
+{
+	avih->totalFrames = m->totalFrames;
+	if(!m->snd) return;
+	if(m->mp3) {
+		auds->length = avih->totalFrames * m->videoFrameLength / mp3framelength(m->mp3);
+	} else {
+		auds->length = avih->totalFrames * m->wavh.samplesPerSec / m->fps / m->adpcmh.samplesPerBlock;
+	}
+}
+
+/* Buffer sizes and peak data rate of what was written so far. */
+static void mux_rates(MUX *m, AVIH *avih, STRH *auds)
+{
+	uint32_t max = 0;
+	int i;
+	for(i = 0; i <= m->streams; i++) {
+		if(m->maxChunk[i] > max) max = m->maxChunk[i];
+	}
+	if(max) avih->suggestedBufferSize = max;
+	if(m->maxBytesPerSec) avih->maxBytesPerSec = m->maxBytesPerSec;
+	if(m->snd && m->maxChunk[m->streams]) auds->suggestedBufferSize = m->maxChunk[m->streams];
+}
+
+/* Seek map entry of chunk about to be written at the end of movi. */
+static void mux_seek(MUX *m, int stream, uint32_t size, uint64_t pts)
+{
+	SEEKMAP_ENTRY e = { m->frames, stream, 0, size, m->moviOffset + m->moviSize + sizeof(CHNK), pts };
+	fwrite(&e, 1, sizeof(e), m->seek);
+}
+
+/* Tracks largest chunk of the stream and bytes per second of movie time. */
+static void mux_account(MUX *m, int stream, size_t size, size_t written)
+{
+	uint32_t second = m->frames / m->fps;
+	if(size > m->maxChunk[stream]) m->maxChunk[stream] = size;
+	if(second != m->second) {
+		m->second = second;
+		m->secondBytes = 0;
+	}
+	m->secondBytes += written;
+	if(m->secondBytes > m->maxBytesPerSec) m->maxBytesPerSec = m->secondBytes;
+}
+
+int mux_begin(MUX *m, FILE *out)
+{
+	fpos_t hdrlPos, strlPos;
+	size_t hdrlSize, strlSize;
+	AVIH avih;
+	STRH strh;
+	BMPH bmph;
+	VPRP vprp;
+	MP3H mp3h;
+	int i;
+
+	if(!(m->idx = tmpfile())) return 0;
+	if((m->checksums && !(m->crc = tmpfile())) || (m->seekmap && m->path && !(m->seek = tmpfile())) ||
+	   (m->events && !(m->evts = tmpfile()))) {
+		fclose(m->idx), m->idx = NULL;
+		if(m->crc) fclose(m->crc), m->crc = NULL;
+		if(m->seek) fclose(m->seek), m->seek = NULL;
+		return 0;
+	}
+	/* detectors survive mux_split, events continue in next file */
+	if(m->events && !m->activity[0].hold) {
+		for(i = 0; i < m->streams; i++) activity_init(&m->activity[i], m->fps, m->events);
+	}
+	m->out = out;
+
+	fgetpos(out, &m->riffPos);
+	fwritechunk(FOURCC_RIFF, 0, out);
+	m->riffSize = fwritecc(FOURCC_AVI, out);
+
+		fgetpos(out, &hdrlPos);
+		m->riffSize += fwritechunk(FOURCC_LIST, 0, out);
+		hdrlSize = fwritecc(FOURCC_HDRL, out);
+
+		hdrlSize += fwritechunk(FOURCC_AVIH, sizeof(avih), out);
+		memset(&avih, 0, sizeof(avih));
+		avih.microSecPerFrame = 1000000 / m->fps;
+		/* placeholders until mux_finish knows real values */
+		avih.maxBytesPerSec = 45000;
+		avih.flags = AVIF_HASINDEX | AVIF_ISINTERLEAVED | AVIF_TRUSTCKTYPE;
+		avih.totalFrames = m->totalFrames;
+		avih.streams = m->streams + (m->snd ? 1 : 0);
+		avih.width = m->vids[0].width;
+		avih.height = m->vids[0].height;
+		avih.suggestedBufferSize = 1024*1024;
+		fgetpos(out, &m->avihPos);
+		hdrlSize += fwrite(&avih, 1, sizeof(avih), out);
+
+			for(i = 0; i < m->streams; i++) {
+				MUX_VIDS *v = &m->vids[i];
+				if(!v->totalFrames) v->totalFrames = m->totalFrames;
+
+				fgetpos(out, &strlPos);
+				hdrlSize += fwritechunk(FOURCC_LIST, 0, out);
+				strlSize = fwritecc(FOURCC_STRL, out);
+
+					strlSize += fwritechunk(FOURCC_STRH, sizeof(strh), out);
+					memset(&strh, 0, sizeof(strh));
+					strh.type = FOURCC_VIDS;
+					strh.handler = CC("MJPG");
+					strh.scale   = 1;
+					strh.rate    = m->fps;
+					strh.quality = (uint32_t)-1;
+					strh.length  = v->totalFrames;
+					strh.suggestedBufferSize = avih.suggestedBufferSize;
+					strh.frame.right  = v->width;
+					strh.frame.bottom = v->height;
+					fgetpos(out, &v->strhPos);
+					strlSize += fwrite(&strh, 1, sizeof(strh), out);
+
+					strlSize += fwritechunk(FOURCC_STRF, sizeof(bmph), out);
+					memset(&bmph, 0, sizeof(bmph));
+					bmph.size     = sizeof(bmph);
+					bmph.width    = v->width;
+					bmph.height   = v->height;
+					bmph.planes   = 1;
+					bmph.bitCount = 24;
+					bmph.imgSize  = bmph.width * bmph.height * bmph.bitCount / 8;
+					bmph.compression = CC("MJPG");
+					strlSize += fwrite(&bmph, 1, sizeof(bmph), out);
+
+					strlSize += fwritechunk(FOURCC_VPRP, sizeof(vprp), out);
+					memset(&vprp, 0, sizeof(vprp));
+					vprp.verticalRefreshRate = m->fps;
+					vprp.hTotalInT           = v->width;
+					vprp.vTotalInLines       = v->height;
+					vprp.frameAspectRatio    = ASPECT_3_2;
+					vprp.frameWidthInPixels  = v->width;
+					vprp.frameHeightInLines  = v->height;
+					vprp.fieldsPerFrame      = 1;
+					vprp.field.compressedBMHeight = v->height;
+					vprp.field.compressedBMWidth  = v->width;
+					vprp.field.validBMHeight      = v->height;
+					vprp.field.validBMWidth       = v->width;
+					strlSize += fwrite(&vprp, 1, sizeof(vprp), out);
+
+					if(m->fastStart) strlSize += mux_indx(m, i, CCSN_T("dc", i), out);
+
+				update(m, &strlPos, strlSize);
+				hdrlSize += strlSize;
+			}
+
+			if(m->snd) {
+				fgetpos(out, &strlPos);
+				hdrlSize += fwritechunk(FOURCC_LIST, 0, out);
+				strlSize = fwritecc(FOURCC_STRL, out);
+
+				if(m->mp3) {
+					strlSize += fwritechunk(FOURCC_STRH, sizeof(strh), out);
+					memset(&strh, 0, sizeof(strh));
+					strh.type = FOURCC_AUDS;
+					strh.scale = 1;
+					strh.rate = mp3bitrate(m->mp3) * 1000 / 8;
+					strh.quality = 10000;
+					strh.initialFrames = 1;
+					strh.length = avih.totalFrames * m->videoFrameLength / mp3framelength(m->mp3);
+					strh.suggestedBufferSize = mp3framesize(m->mp3);
+					strh.sampleSize = 1;
+					fgetpos(out, &m->audsPos);
+					strlSize += fwrite(&strh, 1, sizeof(strh), out);
+
+					strlSize += fwritechunk(FOURCC_STRF, sizeof(mp3h), out);
+					memset(&mp3h, 0, sizeof(mp3h));
+					mp3h.wavh.format = WAVE_FORMAT_MPEGLAYER3;
+					mp3h.wavh.channels = MPEGChannels(m->mp3) == MPEGChannelsMono ? 1 : 2;
+					mp3h.wavh.samplesPerSec = mp3samplerate(m->mp3);
+					mp3h.wavh.avgBytesPerSec = strh.rate;
+					mp3h.wavh.blockAlign = 1;
+					mp3h.size = sizeof(mp3h) - sizeof(mp3h.wavh) - sizeof(mp3h.size);
+					mp3h.id = MPEGLAYER3_ID_MPEG;
+					mp3h.flags = MPEGLAYER3_FLAG_PADDING_ISO;
+					strlSize += fwrite(&mp3h, 1, sizeof(mp3h), out);
+				} else {
+					strlSize += fwritechunk(FOURCC_STRH, sizeof(strh), out);
+					memset(&strh, 0, sizeof(strh));
+					strh.type = FOURCC_AUDS;
+					strh.scale = 253;
+					strh.rate = m->wavh.samplesPerSec / m->wavh.bitsPerSample;
+					strh.quality = (uint32_t)-1;
+					strh.initialFrames = 0;
+					strh.length = avih.totalFrames * m->wavh.samplesPerSec / m->fps / m->adpcmh.samplesPerBlock;
+					/* every chunk is single block */
+					strh.suggestedBufferSize = m->wavh.blockAlign;
+					strh.sampleSize = m->wavh.blockAlign;
+					fgetpos(out, &m->audsPos);
+					strlSize += fwrite(&strh, 1, sizeof(strh), out);
+
+					long sndPos = ftell(m->snd);
+					fseek(m->snd, m->sndFmtPos, SEEK_SET);
+					strlSize += fwritechunk(FOURCC_STRF, m->sndFmtSize, out);
+					strlSize += fcopy(m->snd, out, m->sndFmtSize);
+					fseek(m->snd, sndPos, SEEK_SET);
+				}
+
+				if(m->fastStart) strlSize += mux_indx(m, m->streams, CCSN_T("wb", m->streams), out);
+
+				update(m, &strlPos, strlSize);
+				hdrlSize += strlSize;
+			}
+
+		update(m, &hdrlPos, hdrlSize);
+		m->riffSize += hdrlSize;
+
+		if(m->fastStart) {
+			/* index area sized for planned frames, readers seek without
+			 * going to the end of the file */
+			uint64_t chunks = mux_audio_chunks(m, m->totalFrames);
+			for(i = 0; i < m->streams; i++) m->riffSize += mux_ix(m, i, m->vids[i].totalFrames, out);
+			if(m->snd) m->riffSize += mux_ix(m, m->streams, chunks + chunks / 64 + 4, out);
+			m->ixFull = 0;
+		}
+
+		fgetpos(out, &m->moviPos);
+		m->moviOffset = ftell(out) + sizeof(CHNK);
+		m->riffSize += fwritechunk(FOURCC_LIST, 0, out);
+		m->moviSize = fwritecc(FOURCC_MOVI, out);
+
+	return 1;
+}
+
+/* Writes single audio chunk advancing audio clock. */
+static void mux_audio_chunk(MUX *m)
+{
+	uint64_t start = STATS_START(m->stats);
+	size_t chunkStart = m->moviSize;
+	if(m->mp3) {
+		/* read next mp3 frame */
+		mp3header_t mp3;
+		if(!(mp3 = freadmp3header(m->snd))) {
+			fseek(m->snd, 0, SEEK_SET);
+			if(!(mp3 = freadmp3header(m->snd))) {
+				fclose(m->snd), m->snd = NULL;
+				return;
+			}
+		}
+		m->mp3 = mp3;
+		size_t bufSize = mp3framesize(mp3) - sizeof(mp3);
+		uint8_t buf[bufSize];
+		if(fread(buf, 1, bufSize, m->snd) == bufSize) {
+			uint32_t crc = 0;
+			throttle_take(m->readLimit, mp3framesize(mp3));
+			if(m->crc) {
+				/* header is stored big endian */
+				mp3header_t be = htonl(mp3);
+				crc = crc32c(crc32c(0, &be, sizeof(be)), buf, bufSize);
+			}
+			index_append(m, CCSN_T("wb", m->streams), bufSize + sizeof(mp3), crc);
+			if(m->seek) mux_seek(m, m->streams, bufSize + sizeof(mp3), (uint64_t)(m->audio * 1000000 + 0.5));
+			m->moviSize += fwritechunk(CCSN_T("wb", m->streams), bufSize + sizeof(mp3), m->out);
+			m->moviSize += fwritemp3header(m->out, mp3);
+			m->moviSize += fwritepadded(buf, bufSize, m->out);
+		}
+		m->audio += mp3framelength(mp3);
+	} else {
+		/* read next wav chunk, wrapping around at the end of data */
+		uint8_t buf[m->wavh.blockAlign];
+		if(fread(buf, 1, sizeof(buf), m->snd) != sizeof(buf)) {
+			fseek(m->snd, m->sndDataPos, SEEK_SET);
+			if(fread(buf, 1, sizeof(buf), m->snd) != sizeof(buf)) {
+				fclose(m->snd), m->snd = NULL;
+				return;
+			}
+		}
+		throttle_take(m->readLimit, sizeof(buf));
+		index_append(m, CCSN_T("wb", m->streams), sizeof(buf), m->crc ? crc32c(0, buf, sizeof(buf)) : 0);
+		if(m->seek) mux_seek(m, m->streams, sizeof(buf), (uint64_t)(m->audio * 1000000 + 0.5));
+		m->moviSize += fwritechunk(CCSN_T("wb", m->streams), sizeof(buf), m->out);
+		m->moviSize += fwritepadded(buf, sizeof(buf), m->out);
+		m->audio += (double)m->adpcmh.samplesPerBlock / (double)m->wavh.samplesPerSec;
+	}
+	if(m->moviSize > chunkStart) mux_account(m, m->streams, m->moviSize - chunkStart - sizeof(CHNK), m->moviSize - chunkStart);
+	PROBE_AUDIO_CHUNK(m->frames, m->moviSize - chunkStart, chunkStart);
+	stats_add(m->stats, STATS_AUDIO_WRITE, start, m->moviSize - chunkStart);
+}
+
+int mux_frames(MUX *m, const void *const *data, const size_t *size)
+{
+	uint64_t start;
+	size_t chunkStart, total = 0;
+	EVTS event;
+	int i;
+
+	for(i = 0; i < m->streams; i++) {
+		if(size[i] != MUX_NOFRAME) total += size[i];
+	}
+	if(m->rollover && !m->rollover(m, total, m->rolloverArg)) return 0;
+	PROBE_FRAME_START(m->frames, m->moviSize);
+	while(m->snd && m->audio < m->video + m->videoFrameLength * 2) {
+		mux_audio_chunk(m);
+	}
+
+	for(i = 0; i < m->streams; i++) {
+		FOURCC id = CCSN_T("dc", i);
+		if(size[i] == MUX_NOFRAME) continue;
+		start = STATS_START(m->stats);
+		chunkStart = m->moviSize;
+		if(!data[i]) {
+			m->moviSize += fwritechunk(id, 0, m->out);
+		} else {
+			index_append(m, id, size[i], m->crc ? crc32c(0, data[i], size[i]) : 0);
+			if(m->seek && size[i]) mux_seek(m, i, size[i], (uint64_t)m->frames * 1000000 / m->fps);
+			m->moviSize += fwritechunk(id, size[i], m->out);
+			m->moviSize += fwritepadded(data[i], size[i], m->out);
+			if(m->evts && activity_frame(&m->activity[i], m->frames, size[i], &event)) {
+				event.stream = i;
+				fwrite(&event, 1, sizeof(event), m->evts);
+			}
+		}
+		mux_account(m, i, data[i] ? size[i] : 0, m->moviSize - chunkStart);
+		stats_add(m->stats, STATS_FRAME_WRITE, start, m->moviSize - chunkStart);
+		PROBE_FRAME_END(m->frames, m->moviSize - chunkStart, chunkStart);
+		m->vids[i].frames++;
+	}
+	m->video += m->videoFrameLength;
+	m->frames++;
+	if(m->progress) m->progress(m, m->progressArg);
+	return 1;
+}
+
+int mux_frame(MUX *m, const void *data, size_t size)
+{
+	return mux_frames(m, &data, &size);
+}
+
+/* Closes frame reader, collecting Huffman optimization savings. */
+static void mux_frames_close(MUX *m, FRAMES *frames)
+{
+	uint64_t in, out;
+	frames_savings(frames, &in, &out);
+	m->optimizeIn += in;
+	m->optimizeOut += out;
+	frames_close(frames);
+}
+
+int mux_lists(MUX *m, const char *const *const *paths, const int *counts, int backend)
+{
+	FRAMES *frames[MUX_STREAMS] = { NULL };
+	const void *data[MUX_STREAMS];
+	size_t size[MUX_STREAMS];
+	uint64_t start, frameStart;
+	int frame, ticks = 0, i;
+
+	for(i = 0; i < m->streams; i++) {
+		if(!(frames[i] = frames_open(paths[i], counts[i], backend))) {
+			fprintf(stderr, "Error: Cannot allocate frame reader.\n");
+			while(i-- > 0) frames_close(frames[i]);
+			return 0;
+		}
+		frames_throttle(frames[i], m->readLimit);
+		if(m->optimize) frames_optimize(frames[i], m->optimize);
+		if(counts[i] > ticks) ticks = counts[i];
+	}
+	if(backend == FRAMES_URING && m->streams && frames_backend(frames[0]) != FRAMES_URING) {
+		fprintf(stderr, "Warning: io_uring not available, using stdio.\n");
+	}
+	/* streams share the clock, frames of same time are read together */
+	for(frame = 0; frame < ticks; frame++) {
+		frameStart = STATS_START(m->stats);
+		for(i = 0; i < m->streams; i++) {
+			start = STATS_START(m->stats);
+			if(frame >= counts[i] || !frames_next(frames[i], &data[i], &size[i])) {
+				size[i] = MUX_NOFRAME;
+				continue;
+			}
+			stats_add(m->stats, STATS_FRAME_READ, start, data[i] ? size[i] : 0);
+			if(!data[i]) PROBE_OPEN_FAIL(m->frames, paths[i][frame]);
+		}
+		if(!mux_frames(m, data, size)) break;
+		stats_frame(m->stats, frameStart);
+	}
+	for(i = 0; i < m->streams; i++) mux_frames_close(m, frames[i]);
+	return m->out != NULL;
+}
+
+int mux_paths(MUX *m, const char *const *paths, int count, int backend)
+{
+	return mux_lists(m, &paths, &count, backend);
+}
+
+int mux_timed(MUX *m, const char *const *paths, const int *repeats, int count, int backend)
+{
+	FRAMES *frames;
+	const void *data;
+	size_t size;
+	uint64_t start, frameStart;
+	int frame, i;
+
+	if(!(frames = frames_open(paths, count, backend))) {
+		fprintf(stderr, "Error: Cannot allocate frame reader.\n");
+		return 0;
+	}
+	frames_throttle(frames, m->readLimit);
+	if(m->optimize) frames_optimize(frames, m->optimize);
+	for(frame = 0; frame < count; frame++) {
+		/* zero length indexed chunk makes players hold previous frame */
+		for(i = 0; i < repeats[frame] && m->out; i++) mux_frame(m, "", 0);
+		frameStart = start = STATS_START(m->stats);
+		if(!m->out || !frames_next(frames, &data, &size)) break;
+		stats_add(m->stats, STATS_FRAME_READ, start, data ? size : 0);
+		if(!data) PROBE_OPEN_FAIL(m->frames, paths[frame]);
+		if(!mux_frame(m, data, size)) break;
+		stats_frame(m->stats, frameStart);
+	}
+	mux_frames_close(m, frames);
+	return m->out != NULL;
+}
+
+int mux_tee(MUX *const *muxes, const int *every, int count, const char *const *paths, int frames, int backend)
+{
+	MUX *m = muxes[0];
+	FRAMES *f;
+	const void *data;
+	size_t size;
+	uint64_t start, frameStart;
+	int frame, i, ok = 1;
+
+	if(!(f = frames_open(paths, frames, backend))) {
+		fprintf(stderr, "Error: Cannot allocate frame reader.\n");
+		return 0;
+	}
+	frames_throttle(f, m->readLimit);
+	if(m->optimize) frames_optimize(f, m->optimize);
+	for(frame = 0; frame < frames; frame++) {
+		frameStart = start = STATS_START(m->stats);
+		if(!frames_next(f, &data, &size)) break;
+		stats_add(m->stats, STATS_FRAME_READ, start, data ? size : 0);
+		if(!data) PROBE_OPEN_FAIL(m->frames, paths[frame]);
+		/* frame is read once, outputs take it from the same buffer */
+		for(i = 0; i < count && ok; i++) {
+			if(frame % every[i] == 0) ok = mux_frame(muxes[i], data, size);
+		}
+		if(!ok) break;
+		stats_frame(m->stats, frameStart);
+	}
+	mux_frames_close(m, f);
+	return ok;
+}
+
+/* Fills reserved standard indexes from `idx1' entries written so far and
+ * points super indexes at them. */
+static void mux_fast_start(MUX *m)
+{
+	uint8_t *ix[MUX_STREAMS + 1] = { NULL };
+	uint32_t used[MUX_STREAMS + 1] = { 0 };
+	uint64_t ticks[MUX_STREAMS + 1] = { 0 };
+	int count = m->streams + (m->snd ? 1 : 0), full = 0, i, n;
+	long idxSize = ftell(m->idx);
+	IDX1 idx1[256];
+	size_t got;
+
+	for(i = 0; i < count; i++) {
+		if(!(ix[i] = malloc(sizeof(IXHDR) + (size_t)m->ixEntries[i] * sizeof(IXENTRY)))) goto done;
+	}
+	fseek(m->idx, 0, SEEK_SET);
+	while((got = fread(idx1, sizeof(IDX1), sizeof(idx1) / sizeof(IDX1), m->idx)) > 0) {
+		for(n = 0; n < (int)got; n++) {
+			IXENTRY *e;
+			i = IS_CCSN_T(idx1[n].id, "wb") ? m->streams : CCSN(idx1[n].id);
+			if(i >= count) continue;
+			if(used[i] == m->ixEntries[i]) {
+				full = 1;
+				continue;
+			}
+			/* all frames are key frames, offsets point past chunk header */
+			e = (IXENTRY *)(ix[i] + sizeof(IXHDR)) + used[i]++;
+			e->offset = idx1[n].offset + sizeof(CHNK);
+			e->size = idx1[n].size;
+			/* mp3 stream ticks are bytes, others count chunks */
+			ticks[i] += i == m->streams && m->mp3 ? idx1[n].size : 1;
+		}
+	}
+	fseek(m->idx, idxSize, SEEK_SET);
+
+	for(i = 0; i < count; i++) {
+		FOURCC id = i == m->streams ? CCSN_T("wb", i) : CCSN_T("dc", i);
+		IXHDR hdr = { 2, 0, AVI_INDEX_OF_CHUNKS, used[i], id, m->moviOffset, 0 };
+		INDX indx = { 4, 0, AVI_INDEX_OF_INDEXES, 1, id, { 0 }, m->ixOffset[i],
+		              sizeof(CHNK) + sizeof(IXHDR) + m->ixEntries[i] * sizeof(IXENTRY), ticks[i] };
+		memcpy(ix[i], &hdr, sizeof(hdr));
+		fpatch(m->out, &m->ixPos[i], ix[i], sizeof(IXHDR) + used[i] * sizeof(IXENTRY));
+		fpatch(m->out, &m->indxPos[i], &indx, sizeof(indx));
+	}
+
+done:
+	for(i = 0; i < count; i++) free(ix[i]);
+	if(full && !m->ixFull) {
+		fprintf(stderr, "Warning: Fast start index of `%s' is full, remaining chunks are in `idx1' only.\n", m->path ?: "(stdout)");
+		m->ixFull = 1;
+	}
+}
+
+/* Writes `idx1' after movi data, patches sizes and frame counts. */
+static void mux_finish(MUX *m)
+{
+	uint64_t start = STATS_START(m->stats);
+	long idxSize = ftell(m->idx);
+	size_t riffSize = m->riffSize + m->moviSize;
+	AVIH avih;
+	STRH strh;
+	int i;
+
+	update(m, &m->moviPos, m->moviSize);
+
+	/* rewrite index */
+	riffSize += fwritechunk(FOURCC_IDX1, idxSize, m->out);
+	fseek(m->idx, 0, SEEK_SET);
+	riffSize += fcopy(m->idx, m->out, idxSize);
+	fseek(m->idx, idxSize, SEEK_SET);
+	if(m->crc) {
+		long crcSize = ftell(m->crc);
+		riffSize += fwritechunk(FOURCC_CRCS, crcSize, m->out);
+		fseek(m->crc, 0, SEEK_SET);
+		riffSize += fcopy(m->crc, m->out, crcSize);
+		fseek(m->crc, crcSize, SEEK_SET);
+		idxSize += crcSize + sizeof(CHNK);
+	}
+	if(m->evts) {
+		/* events still in progress end with the file */
+		EVTS pending[MUX_STREAMS];
+		long evtsSize = ftell(m->evts);
+		int count = 0;
+		for(i = 0; i < m->streams; i++) {
+			if(activity_pending(&m->activity[i], &pending[count])) pending[count++].stream = i;
+		}
+		riffSize += fwritechunk(FOURCC_EVTS, evtsSize + count * sizeof(EVTS), m->out);
+		fseek(m->evts, 0, SEEK_SET);
+		riffSize += fcopy(m->evts, m->out, evtsSize);
+		fseek(m->evts, evtsSize, SEEK_SET);
+		riffSize += fwrite(pending, 1, count * sizeof(EVTS), m->out);
+		idxSize += evtsSize + count * sizeof(EVTS) + sizeof(CHNK);
+		m->eventCount = evtsSize / sizeof(EVTS) + count;
+	}
+	stats_add(m->stats, STATS_INDEX, start, idxSize + sizeof(CHNK));
+
+	update(m, &m->riffPos, riffSize);
+
+	if(m->fastStart) mux_fast_start(m);
+
+	if(m->seek && !seekmap_write(m->path, m->seekmap, m->seek, m->fps)) {
+		fprintf(stderr, "Warning: Cannot write seek map of `%s'.\n", m->path);
+	}
+
+	/* frame counts, unless all frames were announced up front, buffer sizes
+	 * and data rate */
+	for(i = 0; i < m->streams; i++) {
+		MUX_VIDS *v = &m->vids[i];
+		if(fpeek(m->out, &v->strhPos, &strh, sizeof(strh))) {
+			v->totalFrames = strh.length = v->frames;
+			if(m->maxChunk[i]) strh.suggestedBufferSize = m->maxChunk[i];
+			fpatch(m->out, &v->strhPos, &strh, sizeof(strh));
+		}
+	}
+	m->totalFrames = m->frames;
+	if(fpeek(m->out, &m->avihPos, &avih, sizeof(avih)) &&
+	   (!m->snd || fpeek(m->out, &m->audsPos, &strh, sizeof(strh)))) {
+		mux_counts(m, &avih, &strh);
+		mux_rates(m, &avih, &strh);
+		fpatch(m->out, &m->avihPos, &avih, sizeof(avih));
+		if(m->snd) fpatch(m->out, &m->audsPos, &strh, sizeof(strh));
+	}
+}
+
+int mux_refresh(MUX *m)
+{
+	fpos_t end;
+	fgetpos(m->out, &end);
+	mux_finish(m);
+	fflush(m->out);
+	fsetpos(m->out, &end);
+	return 1;
+}
+
+int mux_end(MUX *m)
+{
+	mux_finish(m);
+	m->eventTotal += m->eventCount;
+	if(m->idx) fclose(m->idx), m->idx = NULL;
+	if(m->crc) fclose(m->crc), m->crc = NULL;
+	if(m->evts) fclose(m->evts), m->evts = NULL;
+	if(m->seek) fclose(m->seek), m->seek = NULL;
+	if(m->snd) fclose(m->snd), m->snd = NULL;
+	return 1;
+}
+
+int mux_split(MUX *m, FILE *out)
+{
+	int i;
+	mux_finish(m);
+	m->eventTotal += m->eventCount;
+	if(m->idx) fclose(m->idx), m->idx = NULL;
+	if(m->crc) fclose(m->crc), m->crc = NULL;
+	if(m->seek) fclose(m->seek), m->seek = NULL;
+	if(m->evts) fclose(m->evts), m->evts = NULL;
+	if(m->events) {
+		for(i = 0; i < m->streams; i++) activity_split(&m->activity[i], m->frames);
+	}
+	/* clocks restart, audio keeps its lead over video */
+	m->audio -= m->video;
+	m->video = 0;
+	m->frames = m->totalFrames = 0;
+	for(i = 0; i < m->streams; i++) m->vids[i].frames = m->vids[i].totalFrames = 0;
+	memset(m->maxChunk, 0, sizeof(m->maxChunk));
+	m->second = 0;
+	m->secondBytes = m->maxBytesPerSec = 0;
+	if(!mux_begin(m, out)) {
+		/* previous file is complete, there is nowhere to write */
+		m->out = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+uint64_t mux_size(MUX *m)
+{
+	return sizeof(CHNK) + m->riffSize + m->moviSize + sizeof(CHNK) + ftell(m->idx) +
+	       (m->crc ? sizeof(CHNK) + ftell(m->crc) : 0) +
+	       (m->evts ? sizeof(CHNK) + ftell(m->evts) + m->streams * sizeof(EVTS) : 0);
+}
+
+uint64_t mux_estimate(MUX *m, uint32_t frames, uint64_t frameBytes)
+{
+	/* headers, frame chunks, frame index and index chunk */
+	size_t entry = sizeof(CHNK) + sizeof(IDX1) + (m->checksums ? sizeof(uint32_t) : 0) +
+	               (m->fastStart ? sizeof(IXENTRY) : 0);
+	uint64_t total = 4096 + frameBytes + (uint64_t)frames * (entry + 1) +
+	                 sizeof(CHNK) * (1 + (m->checksums ? 1 : 0) + (m->events ? 1 : 0));
+	uint64_t chunks = mux_audio_chunks(m, frames);
+	if(m->snd && m->mp3) {
+		total += chunks * (mp3framesize(m->mp3) + 1 + entry);
+	} else if(m->snd) {
+		total += chunks * (m->wavh.blockAlign + entry);
+	}
+	return total;
+}
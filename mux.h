@@ -0,0 +1,140 @@
+/*
+ * mux.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* requires riff.h, mp3.h, stats.h, throttle.h and activity.h */
+
+typedef struct MUX MUX;
+
+#define MUX_STREAMS 16
+#define MUX_NOFRAME ((size_t)-1) /* stream has no frame at this time */
+
+typedef struct {
+	int      width;
+	int      height;
+	uint32_t totalFrames; /* expected frames, 0 for same as muxer */
+	uint32_t frames;      /* frame times written */
+	fpos_t   strhPos;
+} MUX_VIDS;
+
+struct MUX {
+	/* settings, filled before mux_begin */
+	int      fps;
+	int      streams;     /* video streams, 1 by default */
+	MUX_VIDS vids[MUX_STREAMS];
+	uint32_t totalFrames; /* expected frames, header is patched on refresh and end */
+	STATS   *stats;       /* optional */
+	int      checksums;   /* CRC32C of every indexed chunk in `crcs' chunk */
+	int      seekmap;     /* SEEKMAP_* sidecar formats written next to path */
+	const char *path;     /* output path, names sidecar files */
+	int      optimize;    /* threads re-encoding frames with optimal Huffman
+	                       * tables, -1 for all CPUs, 0 for none */
+	int      fastStart;   /* OpenDML indexes ahead of `movi', needs totalFrames */
+	double   events;      /* activity score threshold of `evts' chunk, 0 for none */
+	THROTTLE *readLimit;  /* optional rate limit of frame and audio reads */
+	THROTTLE *writeLimit; /* same for writers opened on behalf of muxer */
+	/* optional, called before each frame of given size, may switch output
+	 * with mux_split, returns 0 when it failed to */
+	int    (*rollover)(MUX *m, size_t size, void *arg);
+	void    *rolloverArg;
+	/* optional, called after each frame time */
+	void   (*progress)(MUX *m, void *arg);
+	void    *progressArg;
+
+	/* output */
+	FILE    *out;
+	FILE    *idx;
+	FILE    *crc;
+	FILE    *seek;        /* seek map entries */
+	FILE    *evts;        /* ended activity events */
+	ACTIVITY activity[MUX_STREAMS];
+	uint32_t eventCount;  /* events in current file */
+	uint32_t eventTotal;  /* events in finished files */
+	uint64_t moviOffset;  /* file offset of `movi', index offsets are relative to it */
+	/* fast start, entry m->streams is audio */
+	fpos_t   indxPos[MUX_STREAMS + 1], ixPos[MUX_STREAMS + 1]; /* chunk data */
+	uint64_t ixOffset[MUX_STREAMS + 1];
+	uint32_t ixEntries[MUX_STREAMS + 1]; /* reserved standard index entries */
+	int      ixFull;      /* some entries did not fit, warned */
+	fpos_t   riffPos, avihPos, audsPos, moviPos;
+	size_t   riffSize, moviSize;
+	uint32_t frames;      /* frame times written */
+	uint64_t optimizeIn, optimizeOut; /* frame bytes before and after */
+	uint32_t maxChunk[MUX_STREAMS + 1]; /* largest chunk data of each stream, audio last */
+	uint32_t second;      /* movie second being written */
+	uint64_t secondBytes, maxBytesPerSec;
+
+	/* audio */
+	const char *sndPath;
+	FILE    *snd;
+	mp3header_t mp3;
+	WAVH     wavh;
+	ADPCMH   adpcmh;
+	long     sndFmtPos, sndDataPos;
+	size_t   sndFmtSize;
+	double   videoFrameLength, audio, video;
+};
+
+void mux_init(MUX *m, int fps);
+/* Opens and parses MP3 or ADPCM WAV soundtrack, returns 0 when it cannot
+ * be opened, unsupported formats are ignored with a warning. */
+int mux_audio(MUX *m, const char *path);
+/* Parses soundtrack from already opened stream, which muxer takes over.
+ * Returns 0 when format is not supported. */
+int mux_audio_stream(MUX *m, FILE *snd, const char *path);
+/* Uses soundtrack parsed by another muxer, read through own stream over
+ * the same data, so it is parsed only once. */
+void mux_audio_share(MUX *m, const MUX *from, FILE *snd);
+/* Writes headers and opens `movi' list. */
+int mux_begin(MUX *m, FILE *out);
+/* Interleaves audio up to the frame and writes it, NULL data writes empty
+ * chunk for missing frame. Returns 0 when rollover to next output failed. */
+int mux_frame(MUX *m, const void *data, size_t size);
+/* Same for frames of every video stream at same time, streams with
+ * MUX_NOFRAME size are skipped. */
+int mux_frames(MUX *m, const void *const *data, const size_t *size);
+/* Reads frames with given frames backend and muxes them. Returns 0 when
+ * reader cannot be allocated or rollover failed (out is then NULL). */
+int mux_paths(MUX *m, const char *const *paths, int count, int backend);
+/* Same for every video stream, reading frames of same time together. */
+int mux_lists(MUX *m, const char *const *const *paths, const int *counts, int backend);
+/* Like mux_paths, writing repeats[i] empty frames before frame i. */
+int mux_timed(MUX *m, const char *const *paths, const int *repeats, int count, int backend);
+/* Reads frames once and muxes them into several muxers, each taking every
+ * every[i]th frame. Reader settings are taken from first muxer. */
+int mux_tee(MUX *const *muxes, const int *every, int count, const char *const *paths, int frames, int backend);
+/* Writes index and patches header sizes so the file is playable as is,
+ * next frame overwrites the index. */
+int mux_refresh(MUX *m);
+/* Finishes file, closes audio and index, but leaves output open. */
+int mux_end(MUX *m);
+/* Finishes file like mux_end and continues in new output, audio stays open
+ * and its clock continues from where previous file ended. Returns 0 when new
+ * output cannot be started, previous file is then finished and muxer has no
+ * output (out is NULL). */
+int mux_split(MUX *m, FILE *out);
+/* Size of the file if it was finished now. */
+uint64_t mux_size(MUX *m);
+/* Estimated output size for given frames and their total size. */
+uint64_t mux_estimate(MUX *m, uint32_t frames, uint64_t frameBytes);
@@ -0,0 +1,70 @@
+/*
+ * probes.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* USDT static tracepoints for bpftrace, perf and SystemTap, e.g.
+ *
+ *   bpftrace -e 'usdt:./mjpeg:mjpeg:frame__end { @[arg1 >> 10] = count(); }'
+ *
+ * Each probe compiles to single nop when <sys/sdt.h> (systemtap-sdt-dev)
+ * is available, otherwise to nothing. Offsets are relative to `movi' list
+ * like in `idx1' entries, except update which carries absolute offset.
+ *
+ *   frame__start(frame, offset)
+ *   frame__end(frame, bytes, offset)
+ *   audio__chunk(frame, bytes, offset)
+ *   index__append(fourcc, offset, bytes)
+ *   update(offset, value)
+ *   open__fail(frame, path)
+ */
+
+#if defined(__has_include) && !defined(MJPEG_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_SDT 1
+#endif
+#endif
+
+#ifdef HAVE_SDT
+#define PROBE_FRAME_START(frame, offset)         DTRACE_PROBE2(mjpeg, frame__start, frame, offset)
+#define PROBE_FRAME_END(frame, bytes, offset)    DTRACE_PROBE3(mjpeg, frame__end, frame, bytes, offset)
+#define PROBE_AUDIO_CHUNK(frame, bytes, offset)  DTRACE_PROBE3(mjpeg, audio__chunk, frame, bytes, offset)
+#define PROBE_INDEX_APPEND(fcc, offset, bytes)   DTRACE_PROBE3(mjpeg, index__append, fcc, offset, bytes)
+#define PROBE_UPDATE(offset, value)              DTRACE_PROBE2(mjpeg, update, offset, value)
+#define PROBE_OPEN_FAIL(frame, path)             DTRACE_PROBE2(mjpeg, open__fail, frame, path)
+#else
+#define PROBE_FRAME_START(frame, offset)         do {} while(0)
+#define PROBE_FRAME_END(frame, bytes, offset)    do {} while(0)
+#define PROBE_AUDIO_CHUNK(frame, bytes, offset)  do {} while(0)
+#define PROBE_INDEX_APPEND(fcc, offset, bytes)   do {} while(0)
+#define PROBE_UPDATE(offset, value)              do {} while(0)
+#define PROBE_OPEN_FAIL(frame, path)             do {} while(0)
+#endif
+
+/* byte offset stored in fpos_t, only known with glibc */
+#ifdef __GLIBC__
+#define FPOS_OFFSET(pos) ((long long)(pos)->__pos)
+#else
+#define FPOS_OFFSET(pos) (-1LL)
+#endif
@@ -94,6 +94,13 @@ size_t fwritesafe(const void *ptr, size_t size, FILE *out) {
 	return fwrite(ptr, 1, size, out);
 }
 
+size_t fwritepadded(const void *ptr, size_t size, FILE *out) {
+	static const uint8_t pad = 0;
+	if(!out) return 0;
+	/* chunk data is always 2 byte aligned */
+	return fwrite(ptr, 1, size, out) + ((size % 2) ? fwrite(&pad, 1, 1, out) : 0);
+}
+
 long fseeksafe(FILE *out, long pos, int whence) {
 	if(!out) return 0;
 	return fseek(out, pos, whence);
@@ -117,3 +124,25 @@ int fupdate(FILE *out, fpos_t *pos, uint32_t value) {
 	fsetpos(out, &back);
 	return 1;
 }
+
+int fpeek(FILE *in, fpos_t *pos, void *ptr, size_t size) {
+	fpos_t back;
+	size_t read;
+	if(!in) return 0;
+	fgetpos(in, &back);
+	fsetpos(in, pos);
+	read = fread(ptr, 1, size, in);
+	fsetpos(in, &back);
+	return read == size;
+}
+
+int fpatch(FILE *out, fpos_t *pos, const void *ptr, size_t size) {
+	fpos_t back;
+	size_t wrote;
+	if(!out) return 0;
+	fgetpos(out, &back);
+	fsetpos(out, pos);
+	wrote = fwrite(ptr, 1, size, out);
+	fsetpos(out, &back);
+	return wrote == size;
+}
@@ -30,6 +30,7 @@
 #define IS_CCSN(x)     (((x)&0x000000ff) >= '0' && ((x)&0x000000ff) <= '9' && (((x)&0x0000ff00) >> 8) >= '0' && (((x)&0x0000ff00) >> 8) <= '9' && (((x)&0x00ff0000) >> 16) >= 'a' && (((x)&0x00ff0000) >> 16) <= 'z' && ((x) >> 24) >= 'a' && ((x) >> 24) <= 'z')
 #define CCSN(x)        ((((x)&0x000000ff) - '0') * 10 + ((((x)&0x0000ff00) >> 8) - '0'))
 #define IS_CCSN_T(x,s) ((((x) >> 24) == s[1]) && ((((x)&0x00ff0000) >> 16) == s[0]))
+#define CCIX(n)        (((uint32_t)'i') | ((uint32_t)'x' << 8) | (((((uint32_t)n) / 10)+'0') << 16) | (((((uint32_t)n) % 10)+'0') << 24))
 #define CCSN_T(s,n)    (((uint32_t)s[1] << 24) | ((uint32_t)s[0] << 16) | (((((uint32_t)n) % 10)+'0') << 8) | ((((uint32_t)n) / 10)+'0'))
 
 #define FOURCC_RIFF CC("RIFF")
@@ -52,7 +53,10 @@
 #define FOURCC_DMLH CC("dmlh")
 #define FOURCC_MOVI CC("movi")
 #define FOURCC_IDX1 CC("idx1")
+#define FOURCC_INDX CC("indx")
 #define FOURCC_VPRP CC("vprp")
+#define FOURCC_CRCS CC("crcs") /* private, CRC32C of each idx1 entry */
+#define FOURCC_EVTS CC("evts") /* private, activity events, see activity.h */
 
 #define FOURCC_WAVE CC("WAVE")
 #define FOURCC_FMT  CC("fmt ")
@@ -172,6 +176,38 @@ typedef struct {
 	uint32_t size;
 } __attribute__((packed)) IDX1;
 
+#define AVI_INDEX_OF_INDEXES 0x00
+#define AVI_INDEX_OF_CHUNKS  0x01
+
+/* OpenDML super index (`indx' chunk in `strl') with single entry */
+typedef struct {
+	uint16_t longsPerEntry;
+	uint8_t  indexSubType;
+	uint8_t  indexType;
+	uint32_t entriesInUse;
+	uint32_t chunkId;
+	uint32_t reserved[3];
+	uint64_t offset;   /* file offset of `ix##' chunk */
+	uint32_t size;     /* including chunk header */
+	uint32_t duration; /* stream ticks covered */
+} __attribute__((packed)) INDX;
+
+/* OpenDML standard index (`ix##' chunk), followed by entries */
+typedef struct {
+	uint16_t longsPerEntry;
+	uint8_t  indexSubType;
+	uint8_t  indexType;
+	uint32_t entriesInUse;
+	uint32_t chunkId;
+	uint64_t baseOffset;
+	uint32_t reserved;
+} __attribute__((packed)) IXHDR;
+
+typedef struct {
+	uint32_t offset;   /* chunk data relative to base offset */
+	uint32_t size;     /* bit 31 set for non key frames */
+} __attribute__((packed)) IXENTRY;
+
 typedef struct {
 	char time[27];
 	uint16_t width;
@@ -352,6 +388,9 @@ size_t fcopy(FILE *in, FILE *out, uint32_t size);
 size_t fwritechunk(FOURCC fcc, uint32_t size, FILE *out);
 size_t fwritecc(FOURCC fcc, FILE *out);
 size_t fwritesafe(const void *ptr, size_t size, FILE *out);
+size_t fwritepadded(const void *ptr, size_t size, FILE *out);
 long fseeksafe(FILE *out, long pos, int whence);
 void fgetpossafe(FILE *out, fpos_t *pos);
 int fupdate(FILE *out, fpos_t *pos, uint32_t value);
+int fpeek(FILE *in, fpos_t *pos, void *ptr, size_t size);
+int fpatch(FILE *out, fpos_t *pos, const void *ptr, size_t size);
@@ -0,0 +1,78 @@
+/*
+ * seekmap.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "riff.h"
+#include "seekmap.h"
+
+static int seekmap_file(const char *path, const char *ext, int json, FILE *entries, int fps)
+{
+	char name[PATH_MAX], tmp[PATH_MAX];
+	long end = ftell(entries);
+	SEEKMAP_HEADER hdr = { SEEKMAP_MAGIC, SEEKMAP_VERSION, sizeof(SEEKMAP_ENTRY), fps, end / sizeof(SEEKMAP_ENTRY) };
+	SEEKMAP_ENTRY e;
+	FILE *out;
+	uint32_t i;
+	int ok;
+
+	if(snprintf(name, sizeof(name), "%s%s", path, ext) >= (int)sizeof(name) ||
+	   snprintf(tmp, sizeof(tmp), "%s.tmp", name) >= (int)sizeof(tmp) ||
+	   !(out = fopen(tmp, "wb"))) return 0;
+	fseek(entries, 0, SEEK_SET);
+	if(json) {
+		fprintf(out, "{\"fps\":%u,\"frames\":[", fps);
+		for(i = 0; i < hdr.count && fread(&e, 1, sizeof(e), entries) == sizeof(e); i++) {
+			fprintf(out, "%s\n{\"frame\":%u,\"stream\":%u,\"pts\":%.6f,\"offset\":%llu,\"size\":%u}", i ? "," : "",
+				e.frame, e.stream, e.pts / 1e6, (unsigned long long)e.offset, e.size);
+		}
+		fprintf(out, "\n]}\n");
+	} else {
+		fwrite(&hdr, 1, sizeof(hdr), out);
+		for(i = 0; i < hdr.count && fread(&e, 1, sizeof(e), entries) == sizeof(e); i++) {
+			fwrite(&e, 1, sizeof(e), out);
+		}
+	}
+	fseek(entries, end, SEEK_SET);
+	ok = i == hdr.count;
+	if(fclose(out) || !ok || rename(tmp, name)) {
+		remove(tmp);
+		return 0;
+	}
+	return 1;
+}
+
+int seekmap_write(const char *path, int format, FILE *entries, int fps)
+{
+	int ok = 1;
+	fflush(entries);
+	if(format & SEEKMAP_BINARY) ok &= seekmap_file(path, ".seek", 0, entries, fps);
+	if(format & SEEKMAP_JSON) ok &= seekmap_file(path, ".seek.json", 1, entries, fps);
+	return ok;
+}
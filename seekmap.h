@@ -0,0 +1,60 @@
+/*
+ * seekmap.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/* Sidecar mapping frames and audio chunks to their data in the file, so
+ * single frames and time ranges can be served without parsing the index. Binary sidecar is
+ * written to output.avi.seek, JSON one to output.avi.seek.json. */
+
+#define SEEKMAP_BINARY 1
+#define SEEKMAP_JSON   2
+
+#define SEEKMAP_MAGIC   CC("MJSM")
+#define SEEKMAP_VERSION 1
+
+/* Binary sidecar is header followed by entries in file order, which is
+ * also frame and time order. All values are little endian. */
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entrySize;   /* sizeof(SEEKMAP_ENTRY) */
+	uint32_t fps;
+	uint32_t count;
+} __attribute__((packed)) SEEKMAP_HEADER;
+
+typedef struct {
+	uint32_t frame;       /* time slot, frames without data are left out */
+	uint16_t stream;      /* stream number of chunk id, 00dc is 0, audio follows video */
+	uint16_t reserved;
+	uint32_t size;        /* bytes of chunk data */
+	uint64_t offset;      /* absolute file offset of chunk data */
+	uint64_t pts;         /* presentation time in microseconds */
+} __attribute__((packed)) SEEKMAP_ENTRY;
+
+/* Writes sidecar of given format (SEEKMAP_BINARY, SEEKMAP_JSON or both)
+ * next to output path from entries collected in file. Sidecar is written
+ * to temporary file and renamed, so readers never see partial map. Returns
+ * 0 when it cannot be written. */
+int seekmap_write(const char *path, int format, FILE *entries, int fps);
@@ -0,0 +1,305 @@
+/*
+ * segment.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "riff.h"
+#include "mp3.h"
+#include "throttle.h"
+#include "writer.h"
+#include "stats.h"
+#include "activity.h"
+#include "mux.h"
+#include "segment.h"
+
+typedef struct {
+	char    *path;
+	uint64_t size;
+} SEGMENT_FILE;
+
+struct SEGMENT {
+	MUX     *mux;
+	char     pattern[PATH_MAX];
+	uint64_t maxBytes;
+	uint32_t maxFrames;
+	uint64_t budget;
+	size_t   bufSize;
+	int      writerFlags;
+
+	/* current segment, owned by muxing thread */
+	WRITER  *writer;
+	char    *path;
+
+	/* shared with background thread */
+	pthread_t       thread;
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+	int      index;       /* number of current segment */
+	int      quit;
+	WRITER  *ready;       /* next segment, opened ahead */
+	char    *readyPath;
+	int      readyError;
+	FILE    *closing;     /* finished segment to close */
+	char    *closingPath;
+	uint64_t reserve;     /* preallocation for next segment */
+
+	/* finished segments, oldest first, owned by background thread */
+	SEGMENT_FILE *done;
+	int      doneFirst, doneCount;
+	uint64_t doneBytes;
+};
+
+/* Accepts single %d style conversion only, pattern is used as format. */
+static int segment_pattern(SEGMENT *s, const char *pattern)
+{
+	const char *p = strchr(pattern, '%'), *base, *ext;
+	if(p) {
+		const char *q = p + 1;
+		while(*q == '0' || *q == '-' || *q == ' ' || *q == '+') q++;
+		while(*q >= '0' && *q <= '9') q++;
+		if(*q != 'd' || strchr(q, '%')) return 0;
+		return snprintf(s->pattern, sizeof(s->pattern), "%s", pattern) < (int)sizeof(s->pattern);
+	}
+	/* rec.avi becomes rec-%04d.avi */
+	base = strrchr(pattern, '/');
+	ext = strrchr(base ? base : pattern, '.');
+	if(!ext) ext = pattern + strlen(pattern);
+	return snprintf(s->pattern, sizeof(s->pattern), "%.*s-%%04d%s", (int)(ext - pattern), pattern, ext) < (int)sizeof(s->pattern);
+}
+
+static char *segment_path(SEGMENT *s, int index)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), s->pattern, index);
+	return strdup(path);
+}
+
+/* Seek map sidecars go with their segment. */
+static void segment_unlink_sidecars(const char *path)
+{
+	char name[PATH_MAX];
+	if(snprintf(name, sizeof(name), "%s.seek", path) < (int)sizeof(name)) unlink(name);
+	if(snprintf(name, sizeof(name), "%s.seek.json", path) < (int)sizeof(name)) unlink(name);
+}
+
+/* Deletes oldest segments until next one fits into budget, lock is held. */
+static void segment_retain(SEGMENT *s)
+{
+	uint64_t next = s->maxBytes ? s->maxBytes : s->reserve;
+	while(s->budget && s->doneFirst < s->doneCount && s->doneBytes + next > s->budget) {
+		SEGMENT_FILE *f = &s->done[s->doneFirst++];
+		s->doneBytes -= f->size;
+		pthread_mutex_unlock(&s->lock);
+		if(unlink(f->path) < 0) {
+			fprintf(stderr, "Warning: Cannot delete segment `%s'.\n", f->path);
+		}
+		segment_unlink_sidecars(f->path);
+		free(f->path);
+		pthread_mutex_lock(&s->lock);
+	}
+}
+
+static void *segment_thread(void *arg)
+{
+	SEGMENT *s = arg;
+	pthread_mutex_lock(&s->lock);
+	for(;;) {
+		if(s->closing) {
+			/* close outside of muxing thread, flush and truncate may take long */
+			FILE *f = s->closing;
+			char *path = s->closingPath;
+			struct stat st;
+			SEGMENT_FILE *grown;
+			s->closing = NULL;
+			pthread_cond_broadcast(&s->cond);
+			pthread_mutex_unlock(&s->lock);
+			if(fclose(f) < 0) fprintf(stderr, "Warning: Cannot write segment `%s'.\n", path);
+			st.st_size = 0;
+			stat(path, &st);
+			pthread_mutex_lock(&s->lock);
+			if(!s->maxBytes) s->reserve = st.st_size;
+			if((grown = realloc(s->done, (s->doneCount + 1) * sizeof(SEGMENT_FILE)))) {
+				s->done = grown;
+				s->done[s->doneCount].path = path;
+				s->done[s->doneCount++].size = st.st_size;
+				s->doneBytes += st.st_size;
+			} else {
+				free(path);
+			}
+			segment_retain(s);
+		} else if(!s->ready && !s->readyError && !s->quit) {
+			char *path = segment_path(s, s->index + 1);
+			uint64_t reserve = s->reserve;
+			WRITER *w;
+			pthread_mutex_unlock(&s->lock);
+			if((w = writer_open(path, s->bufSize, s->writerFlags)) && reserve) writer_reserve(w, reserve);
+			writer_throttle(w, s->mux->writeLimit);
+			pthread_mutex_lock(&s->lock);
+			if(w) {
+				s->ready = w;
+				s->readyPath = path;
+			} else {
+				fprintf(stderr, "Warning: Cannot open segment `%s'.\n", path);
+				s->readyError = 1;
+				free(path);
+			}
+			pthread_cond_broadcast(&s->cond);
+		} else if(s->quit) {
+			break;
+		} else {
+			pthread_cond_wait(&s->cond, &s->lock);
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+static int segment_rollover(MUX *m, size_t size, void *arg)
+{
+	SEGMENT *s = arg;
+	WRITER *next;
+	FILE *prev;
+	char *path;
+
+	if(m->frames == 0) return 1;
+	if(!(s->maxBytes && mux_size(m) + size + 1 + sizeof(CHNK) + sizeof(IDX1) > s->maxBytes) &&
+	   !(s->maxFrames && m->frames >= s->maxFrames)) return 1;
+
+	pthread_mutex_lock(&s->lock);
+	while(!s->ready && !s->readyError) pthread_cond_wait(&s->cond, &s->lock);
+	if(!(next = s->ready)) {
+		/* keep recording into current segment, retry on next frame */
+		s->readyError = 0;
+		pthread_cond_broadcast(&s->cond);
+		pthread_mutex_unlock(&s->lock);
+		return 1;
+	}
+	path = s->readyPath;
+	s->ready = NULL;
+	pthread_mutex_unlock(&s->lock);
+
+	fprintf(stderr, "AVI `%s' %u frames\n", s->path, m->frames);
+	prev = writer_file(s->writer);
+	if(!mux_split(m, writer_file(next))) {
+		fprintf(stderr, "Error: Cannot create temporary index for `%s'.\n", path);
+		fclose(writer_file(next));
+		unlink(path);
+		free(path);
+		/* no more segments, segment_close finishes the last one */
+		pthread_mutex_lock(&s->lock);
+		s->readyError = 1;
+		pthread_mutex_unlock(&s->lock);
+		return 0;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	while(s->closing) pthread_cond_wait(&s->cond, &s->lock);
+	s->closing = prev;
+	s->closingPath = s->path;
+	s->writer = next;
+	s->path = path;
+	s->index++;
+	m->path = path;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	return 1;
+}
+
+SEGMENT *segment_open(MUX *m, const char *pattern, uint64_t maxBytes, int maxSeconds,
+                      uint64_t budget, size_t bufSize, int writerFlags)
+{
+	SEGMENT *s = calloc(1, sizeof(SEGMENT));
+	if(!s) return NULL;
+	s->mux = m;
+	s->maxBytes = maxBytes;
+	s->maxFrames = maxSeconds * m->fps;
+	s->budget = budget;
+	s->bufSize = bufSize;
+	s->writerFlags = writerFlags;
+	s->reserve = maxBytes;
+	if(!segment_pattern(s, pattern) || !(s->path = segment_path(s, 0)) ||
+	   !(s->writer = writer_open(s->path, bufSize, writerFlags))) {
+		free(s->path);
+		free(s);
+		return NULL;
+	}
+	if(maxBytes) writer_reserve(s->writer, maxBytes);
+	writer_throttle(s->writer, m->writeLimit);
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	if(pthread_create(&s->thread, NULL, segment_thread, s)) {
+		fclose(writer_file(s->writer));
+		free(s->path);
+		free(s);
+		return NULL;
+	}
+	m->rollover = segment_rollover;
+	m->rolloverArg = s;
+	m->path = s->path;
+	return s;
+}
+
+FILE *segment_file(SEGMENT *s)
+{
+	return writer_file(s->writer);
+}
+
+WRITER *segment_writer(SEGMENT *s)
+{
+	return s->writer;
+}
+
+void segment_close(SEGMENT *s)
+{
+	int i;
+	s->mux->rollover = NULL;
+	pthread_mutex_lock(&s->lock);
+	while(s->closing) pthread_cond_wait(&s->cond, &s->lock);
+	s->closing = writer_file(s->writer);
+	s->closingPath = s->path;
+	s->quit = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, NULL);
+
+	/* next segment was not needed */
+	if(s->ready) {
+		fclose(writer_file(s->ready));
+		unlink(s->readyPath);
+		free(s->readyPath);
+	}
+	for(i = s->doneFirst; i < s->doneCount; i++) free(s->done[i].path);
+	free(s->done);
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	free(s);
+}
@@ -0,0 +1,44 @@
+/*
+ * segment.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* requires writer.h and mux.h */
+
+typedef struct SEGMENT SEGMENT;
+
+/* Splits muxer output into numbered files. Pattern contains printf style
+ * number conversion like rec-%04d.avi, otherwise number is inserted before
+ * the extension. File rolls over before frame that would make it exceed
+ * maxBytes or maxSeconds of video (0 for no limit). When budget is not 0,
+ * oldest finished segments are deleted to keep total size within budget.
+ * Next segment is opened and preallocated, finished segments closed and
+ * deleted by background thread. Returns NULL if first segment cannot be
+ * opened. */
+SEGMENT *segment_open(MUX *m, const char *pattern, uint64_t maxBytes, int maxSeconds,
+                      uint64_t budget, size_t bufSize, int writerFlags);
+/* Output of current segment, first one before mux_begin. */
+FILE *segment_file(SEGMENT *s);
+WRITER *segment_writer(SEGMENT *s);
+/* Closes current segment after mux_end, waits for background work. */
+void segment_close(SEGMENT *s);
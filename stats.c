@@ -0,0 +1,131 @@
+/*
+ * stats.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+static const char *phase_names[STATS_PHASES] = {
+	"probe", "audio_setup", "frame_read", "frame_write", "audio_write", "index", "update"
+};
+
+uint64_t stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void stats_init(STATS *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->start = stats_now();
+}
+
+void stats_add(STATS *s, int phase, uint64_t start, uint64_t bytes)
+{
+	if(!s) return;
+	s->phase[phase].calls++;
+	s->phase[phase].nsec += stats_now() - start;
+	s->phase[phase].bytes += bytes;
+}
+
+static int bucket(uint64_t ns)
+{
+	int msb;
+	if(ns < (1 << STATS_SUBBITS)) return (int)ns;
+	msb = 63 - __builtin_clzll(ns);
+	return ((msb - STATS_SUBBITS + 1) << STATS_SUBBITS) | (int)((ns >> (msb - STATS_SUBBITS)) & ((1 << STATS_SUBBITS) - 1));
+}
+
+/* upper bound of values that fall into bucket */
+static uint64_t bucket_value(int b)
+{
+	int shift = (b >> STATS_SUBBITS) - 1;
+	uint64_t sub = b & ((1 << STATS_SUBBITS) - 1);
+	if(shift < 0) return sub;
+	return (((1ull << STATS_SUBBITS) | sub) + 1) << shift;
+}
+
+void stats_frame(STATS *s, uint64_t start)
+{
+	uint64_t ns;
+	if(!s) return;
+	ns = stats_now() - start;
+	s->latency[bucket(ns)]++;
+	if(ns > s->maxLatency) s->maxLatency = ns;
+	s->frames++;
+}
+
+uint64_t stats_percentile(STATS *s, double p)
+{
+	uint64_t rank = (uint64_t)(p * s->frames), seen = 0;
+	int b;
+	if(!s->frames) return 0;
+	if(rank >= s->frames) rank = s->frames - 1;
+	for(b = 0; b < STATS_BUCKETS; b++) {
+		seen += s->latency[b];
+		if(seen > rank) {
+			uint64_t v = bucket_value(b);
+			return v < s->maxLatency ? v : s->maxLatency;
+		}
+	}
+	return s->maxLatency;
+}
+
+void stats_print(STATS *s, FILE *out, int format)
+{
+	double seconds = (stats_now() - s->start) / 1e9;
+	uint64_t bytes = 0;
+	int i;
+
+	for(i = 0; i < STATS_PHASES; i++) {
+		if(i != STATS_AUDIO_SETUP && i != STATS_FRAME_READ) bytes += s->phase[i].bytes;
+	}
+	if(format == STATS_JSON) {
+		fprintf(out, "{\"seconds\":%.6f,\"frames\":%llu,\"bytes\":%llu,\"fps\":%.1f,\"mbps\":%.3f,\"phases\":{",
+			seconds, (unsigned long long)s->frames, (unsigned long long)bytes,
+			seconds > 0 ? s->frames / seconds : 0, seconds > 0 ? bytes / seconds / 1e6 : 0);
+		for(i = 0; i < STATS_PHASES; i++) {
+			fprintf(out, "%s\"%s\":{\"calls\":%llu,\"seconds\":%.6f,\"bytes\":%llu}", i ? "," : "", phase_names[i],
+				(unsigned long long)s->phase[i].calls, s->phase[i].nsec / 1e9, (unsigned long long)s->phase[i].bytes);
+		}
+		fprintf(out, "},\"frame_latency_us\":{\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}}\n",
+			stats_percentile(s, 0.50) / 1e3, stats_percentile(s, 0.99) / 1e3, s->maxLatency / 1e3);
+		return;
+	}
+	fprintf(out, "Stats: %llu frames, %llu bytes written in %.3f s, %.1f frames/s, %.3f MB/s\n",
+		(unsigned long long)s->frames, (unsigned long long)bytes, seconds,
+		seconds > 0 ? s->frames / seconds : 0, seconds > 0 ? bytes / seconds / 1e6 : 0);
+	for(i = 0; i < STATS_PHASES; i++) {
+		fprintf(out, "  %-12s %10llu calls %12.6f s %14llu bytes\n", phase_names[i],
+			(unsigned long long)s->phase[i].calls, s->phase[i].nsec / 1e9, (unsigned long long)s->phase[i].bytes);
+	}
+	fprintf(out, "  frame latency p50 %.3f us, p99 %.3f us, max %.3f us\n",
+		stats_percentile(s, 0.50) / 1e3, stats_percentile(s, 0.99) / 1e3, s->maxLatency / 1e3);
+}
@@ -0,0 +1,64 @@
+/*
+ * stats.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define STATS_PROBE       0 /* first frame header probe */
+#define STATS_AUDIO_SETUP 1 /* audio file open and format parsing */
+#define STATS_FRAME_READ  2 /* frame open and read */
+#define STATS_FRAME_WRITE 3 /* frame chunk and index entry write */
+#define STATS_AUDIO_WRITE 4 /* audio chunk read and write */
+#define STATS_INDEX       5 /* index rewrite at the end of file */
+#define STATS_UPDATE      6 /* fupdate header size patches */
+#define STATS_PHASES      7
+
+/* latency histogram has 8 linear sub-buckets per power of 2 nanoseconds */
+#define STATS_SUBBITS 3
+#define STATS_BUCKETS (64 << STATS_SUBBITS)
+
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+typedef struct {
+	uint64_t calls;
+	uint64_t nsec;
+	uint64_t bytes;
+} STATS_PHASE;
+
+typedef struct {
+	uint64_t    start;
+	uint64_t    frames;
+	uint64_t    maxLatency;
+	STATS_PHASE phase[STATS_PHASES];
+	uint64_t    latency[STATS_BUCKETS];
+} STATS;
+
+/* Zero cost when statistics are disabled, no clock is read. */
+#define STATS_START(s) ((s) ? stats_now() : 0)
+
+uint64_t stats_now(void);
+void stats_init(STATS *s);
+void stats_add(STATS *s, int phase, uint64_t start, uint64_t bytes);
+void stats_frame(STATS *s, uint64_t start);
+uint64_t stats_percentile(STATS *s, double p);
+void stats_print(STATS *s, FILE *out, int format);
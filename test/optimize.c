@@ -0,0 +1,301 @@
+/*
+ * optimize.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/* Feeds mjpeg --optimize with frames carrying malformed Huffman tables and
+ * checks that they end up in the movie untouched, while a valid frame with
+ * wasteful tables gets re-encoded to the very same coefficients. */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "../bench/synth.h"
+
+#define WIDTH      64
+#define HEIGHT     64
+#define MAX_BLOCKS 4096
+
+/* Plain baseline decoder written apart from jpeg.c, so that a bug in its
+ * Huffman coder cannot hide itself. Decodes entropy coded data to quantized
+ * coefficients, which lossless re-encoding must keep. */
+typedef struct {
+	uint8_t bits[17];
+	uint8_t vals[256];
+} TABLE;
+
+typedef struct {
+	const uint8_t *p, *end;
+	int acc, bits;
+} READER;
+
+static int get_bit(READER *r)
+{
+	if(!r->bits) {
+		if(r->p >= r->end) return -1;
+		r->acc = *r->p++;
+		/* stuffed zero follows data 0xFF, anything else is a marker */
+		if(r->acc == 0xFF && (r->p >= r->end || *r->p++ != 0)) return -1;
+		r->bits = 8;
+	}
+	return (r->acc >> --r->bits) & 1;
+}
+
+static int decode(READER *r, const TABLE *t)
+{
+	int code = 0, first = 0, index = 0, l, b;
+	for(l = 1; l <= 16; l++) {
+		if((b = get_bit(r)) < 0) return -1;
+		code = code << 1 | b;
+		if(code >= first && code - first < t->bits[l]) return t->vals[index + code - first];
+		index += t->bits[l];
+		first = (first + t->bits[l]) << 1;
+	}
+	return -1;
+}
+
+static int receive(READER *r, int size, int *value)
+{
+	int v = 0, b, i;
+	for(i = 0; i < size; i++) {
+		if((b = get_bit(r)) < 0) return 0;
+		v = v << 1 | b;
+	}
+	if(size && v < 1 << (size - 1)) v -= (1 << size) - 1;
+	*value = v;
+	return 1;
+}
+
+/* Returns number of 8x8 blocks decoded to coefs, -1 when frame is not
+ * single scan baseline JPEG without restart markers. */
+static int decode_jpeg(const uint8_t *p, size_t size, int16_t (*coefs)[64], int maxBlocks)
+{
+	TABLE tables[2][4];
+	const uint8_t *end = p + size;
+	int width = 0, height = 0, comps = 0, id[4], h[4], v[4], hmax = 1, vmax = 1;
+	int dc[4], ac[4], pred[4] = { 0 }, scan[4], scanComps, blocks = 0, mcus, mcu, i, j, k, x, y;
+	READER r;
+
+	memset(tables, 0, sizeof(tables));
+	if(size < 4 || p[0] != 0xFF || p[1] != 0xD8) return -1;
+	for(p += 2;;) {
+		size_t len;
+		if(end - p < 4 || p[0] != 0xFF) return -1;
+		len = p[2] << 8 | p[3];
+		if(len < 2 || (size_t)(end - p - 2) < len) return -1;
+		if(p[1] == 0xC4) {
+			const uint8_t *t = p + 4;
+			while(t + 17 <= p + 2 + len) {
+				TABLE *table = &tables[t[0] >> 4 & 1][t[0] & 3];
+				int total = 0;
+				for(i = 1; i <= 16; i++) total += table->bits[i] = t[i];
+				if(total > 256 || t + 17 + total > p + 2 + len) return -1;
+				memcpy(table->vals, t + 17, total);
+				t += 17 + total;
+			}
+		} else if(p[1] == 0xC0 || p[1] == 0xC1) {
+			height = p[5] << 8 | p[6];
+			width = p[7] << 8 | p[8];
+			if((comps = p[9]) < 1 || comps > 4) return -1;
+			for(i = 0; i < comps; i++) {
+				id[i] = p[10 + i * 3];
+				if((h[i] = p[11 + i * 3] >> 4) > hmax) hmax = h[i];
+				if((v[i] = p[11 + i * 3] & 15) > vmax) vmax = v[i];
+			}
+		} else if(p[1] == 0xDD || (p[1] >= 0xC2 && p[1] <= 0xCF)) {
+			return -1;
+		} else if(p[1] == 0xDA) {
+			if(!comps || (scanComps = p[4]) < 1 || scanComps > comps) return -1;
+			for(i = 0; i < scanComps; i++) {
+				for(scan[i] = 0; scan[i] < comps && id[scan[i]] != p[5 + i * 2]; scan[i]++);
+				if(scan[i] == comps) return -1;
+				dc[scan[i]] = p[6 + i * 2] >> 4 & 1;
+				ac[scan[i]] = p[6 + i * 2] & 3;
+			}
+			p += 2 + len;
+			break;
+		}
+		p += 2 + len;
+	}
+
+	r.p = p;
+	r.end = end - 2;
+	r.bits = 0;
+	if(scanComps == 1) {
+		/* non-interleaved scan covers component in single blocks */
+		i = scan[0];
+		x = ((width * h[i] + hmax - 1) / hmax + 7) / 8;
+		y = ((height * v[i] + vmax - 1) / vmax + 7) / 8;
+		mcus = x * y;
+	} else {
+		mcus = ((width + 8 * hmax - 1) / (8 * hmax)) * ((height + 8 * vmax - 1) / (8 * vmax));
+	}
+	for(mcu = 0; mcu < mcus; mcu++) {
+		for(j = 0; j < scanComps; j++) {
+			int c = scan[j], n = scanComps == 1 ? 1 : h[c] * v[c];
+			while(n--) {
+				int16_t *block;
+				int s, value;
+				if(blocks == maxBlocks) return -1;
+				block = coefs[blocks++];
+				memset(block, 0, 64 * sizeof(int16_t));
+				if((s = decode(&r, &tables[0][dc[c]])) < 0 || s > 11 || !receive(&r, s, &value)) return -1;
+				block[0] = pred[c] += value;
+				for(k = 1; k < 64; k++) {
+					if((s = decode(&r, &tables[1][ac[c]])) < 0) return -1;
+					if(!(s & 15)) {
+						if(s != 0xF0) break;
+						k += 15;
+						continue;
+					}
+					k += s >> 4;
+					if(k > 63 || !receive(&r, s & 15, &value)) return -1;
+					block[k] = value;
+				}
+			}
+		}
+	}
+	return blocks;
+}
+
+/* Muxes single frame with --optimize, returns copy of frame as stored in
+ * the movie, NULL when mjpeg failed. */
+static uint8_t *mux(const char *mjpeg, const char *dir, const uint8_t *jpeg, size_t size, size_t *stored)
+{
+	char path[4200], outPath[4200];
+	uint8_t *avi = NULL, *frame = NULL, *movi, *chunk;
+	struct stat st;
+	int status, fd;
+	pid_t pid;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/frame.jpg", dir);
+	snprintf(outPath, sizeof(outPath), "%s/out.avi", dir);
+	if(!(f = fopen(path, "wb"))) return NULL;
+	fwrite(jpeg, 1, size, f);
+	if(fclose(f)) return NULL;
+
+	if((pid = fork()) < 0) return NULL;
+	if(pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		if(null >= 0) dup2(null, 2);
+		execl(mjpeg, mjpeg, "--optimize", "-o", outPath, path, (char *)NULL);
+		_exit(127);
+	}
+	if(waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) goto done;
+	if((fd = open(outPath, O_RDONLY)) < 0) goto done;
+	if(!fstat(fd, &st) && (avi = malloc(st.st_size)) && read(fd, avi, st.st_size) == st.st_size &&
+	   (movi = memmem(avi, st.st_size, "movi", 4)) &&
+	   (chunk = memmem(movi, avi + st.st_size - movi, "00dc", 4)) && chunk + 8 <= avi + st.st_size) {
+		*stored = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (size_t)chunk[7] << 24;
+		if(chunk + 8 + *stored <= avi + st.st_size && (frame = malloc(*stored))) memcpy(frame, chunk + 8, *stored);
+	}
+	close(fd);
+
+done:
+	free(avi);
+	unlink(path);
+	unlink(outPath);
+	return frame;
+}
+
+/* Frame must come out of the movie byte for byte. */
+static int untouched(const char *mjpeg, const char *dir, const uint8_t *jpeg, size_t size)
+{
+	size_t stored;
+	uint8_t *frame = mux(mjpeg, dir, jpeg, size, &stored);
+	int ret = frame && stored == size && !memcmp(frame, jpeg, size);
+	free(frame);
+	return ret;
+}
+
+/* Frame must come out smaller, decoding to the same coefficients. */
+static int reencoded(const char *mjpeg, const char *dir, const uint8_t *jpeg, size_t size)
+{
+	static int16_t before[MAX_BLOCKS][64], after[MAX_BLOCKS][64];
+	size_t stored;
+	uint8_t *frame = mux(mjpeg, dir, jpeg, size, &stored);
+	int blocks = decode_jpeg(jpeg, size, before, MAX_BLOCKS), ret;
+	ret = frame && stored < size && blocks > 0 && decode_jpeg(frame, stored, after, MAX_BLOCKS) == blocks &&
+	      !memcmp(before, after, blocks * sizeof(*before));
+	free(frame);
+	return ret;
+}
+
+int main(int argc, char const *argv[])
+{
+	const char *mjpeg = "./mjpeg";
+	uint8_t *jpeg, dht[17 + 256];
+	char dir[4096];
+	size_t size;
+	int failed = 0, ret, i;
+
+	if(argc == 3 && !strcmp(argv[1], "-m")) {
+		mjpeg = argv[2];
+	} else if(argc != 1) {
+		fprintf(stderr, "Usage: %s [-m mjpeg]\n", argv[0]);
+		return 255;
+	}
+	snprintf(dir, sizeof(dir), "%s/mjpeg-test.XXXXXX", getenv("TMPDIR") ?: "/tmp");
+	if(!mkdtemp(dir)) {
+		fprintf(stderr, "Error: Cannot create temporary directory `%s'.\n", dir);
+		return 1;
+	}
+	if(!(jpeg = malloc(synth_jpeg_max(WIDTH, HEIGHT)))) return 1;
+
+	size = synth_jpeg(jpeg, WIDTH, HEIGHT, 4096, 1, NULL, 0);
+	ret = reencoded(mjpeg, dir, jpeg, size);
+	printf("%-40s %s\n", "valid tables re-encoded losslessly", ret ? "ok" : "FAILED");
+	failed |= !ret;
+
+	/* 200 codes of length 1 run past the lookup table */
+	memset(dht, 0, sizeof(dht));
+	dht[1] = 200;
+	for(i = 0; i < 200; i++) dht[17 + i] = i % 12;
+	size = synth_jpeg(jpeg, WIDTH, HEIGHT, 4096, 1, dht, 17 + 200);
+	ret = untouched(mjpeg, dir, jpeg, size);
+	printf("%-40s %s\n", "oversubscribed table left untouched", ret ? "ok" : "FAILED");
+	failed |= !ret;
+
+	/* both 1 bit codes used, so 2 bit code does not fit */
+	memset(dht, 0, sizeof(dht));
+	dht[1] = 2, dht[2] = 1;
+	dht[17] = 0, dht[18] = 1, dht[19] = 2;
+	size = synth_jpeg(jpeg, WIDTH, HEIGHT, 4096, 1, dht, 17 + 3);
+	ret = untouched(mjpeg, dir, jpeg, size);
+	printf("%-40s %s\n", "overfull table left untouched", ret ? "ok" : "FAILED");
+	failed |= !ret;
+
+	free(jpeg);
+	rmdir(dir);
+	return failed;
+}
@@ -0,0 +1,113 @@
+/*
+ * throttle.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "throttle.h"
+
+struct THROTTLE {
+	pthread_mutex_t lock;
+	double   rate;   /* bytes per second */
+	double   burst;  /* bucket capacity */
+	double   tokens; /* negative while in debt */
+	uint64_t last;   /* time of last refill */
+	uint64_t waited;
+};
+
+static uint64_t throttle_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+THROTTLE *throttle_open(double rate, double burst)
+{
+	THROTTLE *t;
+	if(rate <= 0 || !(t = calloc(1, sizeof(THROTTLE)))) return NULL;
+	pthread_mutex_init(&t->lock, NULL);
+	t->rate = rate;
+	t->burst = burst > 0 ? burst : rate;
+	t->tokens = t->burst;
+	t->last = throttle_now();
+	return t;
+}
+
+void throttle_take(THROTTLE *t, size_t bytes)
+{
+	uint64_t now, wait = 0;
+	struct timespec ts;
+	if(!t || !bytes) return;
+	pthread_mutex_lock(&t->lock);
+	now = throttle_now();
+	t->tokens += (now - t->last) * t->rate / 1e9;
+	if(t->tokens > t->burst) t->tokens = t->burst;
+	t->last = now;
+	/* going into debt serializes threads, each one sleeps until bytes taken
+	 * by everyone before it are paid off */
+	t->tokens -= bytes;
+	if(t->tokens < 0) {
+		wait = (uint64_t)(-t->tokens / t->rate * 1e9);
+		t->waited += wait;
+	}
+	pthread_mutex_unlock(&t->lock);
+	if(!wait) return;
+	ts.tv_sec = wait / 1000000000ull;
+	ts.tv_nsec = wait % 1000000000ull;
+	while(nanosleep(&ts, &ts) < 0 && errno == EINTR);
+}
+
+size_t throttle_chunk(THROTTLE *t, size_t max)
+{
+	double chunk;
+	if(!t) return max;
+	chunk = t->rate / THROTTLE_SLICE;
+	if(chunk > t->burst) chunk = t->burst;
+	if(chunk < THROTTLE_MINCHUNK) chunk = THROTTLE_MINCHUNK;
+	if(chunk >= max) return max;
+	return (size_t)chunk / THROTTLE_MINCHUNK * THROTTLE_MINCHUNK;
+}
+
+uint64_t throttle_waited(THROTTLE *t)
+{
+	uint64_t waited;
+	if(!t) return 0;
+	pthread_mutex_lock(&t->lock);
+	waited = t->waited;
+	pthread_mutex_unlock(&t->lock);
+	return waited;
+}
+
+void throttle_close(THROTTLE *t)
+{
+	if(!t) return;
+	pthread_mutex_destroy(&t->lock);
+	free(t);
+}
@@ -0,0 +1,46 @@
+/*
+ * throttle.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define THROTTLE_SLICE    20          /* chunks per second of rate */
+#define THROTTLE_MINCHUNK (64*1024)   /* smallest chunk, multiple of 4096 */
+
+typedef struct THROTTLE THROTTLE;
+
+/* Opens token bucket refilled with given rate in bytes per second, holding
+ * at most burst bytes (0 for one second of rate). Bucket is shared by all
+ * threads taking from it. Returns NULL for zero rate. */
+THROTTLE *throttle_open(double rate, double burst);
+/* Takes bytes from the bucket, sleeping while it is in debt. Bytes may be
+ * taken before or after the transfer, NULL bucket does nothing. */
+void throttle_take(THROTTLE *t, size_t bytes);
+/* Adaptive transfer size, about 1/THROTTLE_SLICE of a second at limited
+ * rate, so the device sees steady stream of small requests instead of
+ * bursts of max bytes followed by long sleeps. Multiple of 4096 when max is,
+ * max for NULL bucket. */
+size_t throttle_chunk(THROTTLE *t, size_t max);
+/* Total time spent sleeping in nanoseconds. */
+uint64_t throttle_waited(THROTTLE *t);
+void throttle_close(THROTTLE *t);
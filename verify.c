@@ -0,0 +1,196 @@
+/*
+ * verify.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "riff.h"
+#include "crc32c.h"
+#include "stats.h"
+#include "verify.h"
+
+#define VERIFY_BLOCK (8 * 1024 * 1024)
+
+typedef struct {
+	int       fd;
+	uint64_t  movi;    /* file offset of `movi', index offsets are relative to it */
+	IDX1     *idx;
+	uint32_t *crcs;
+	uint8_t  *bad;     /* 1 mismatch, 2 read error */
+} VERIFY;
+
+typedef struct {
+	VERIFY   *v;
+	uint32_t  first, last;
+	uint64_t  bytes;
+	pthread_t thread;
+	int       started;
+} VERIFY_PART;
+
+/* Checks entries of the part, reading ahead whole blocks past small gaps
+ * of chunk headers, so each block is single sequential read. */
+static void *verify_part(void *arg)
+{
+	VERIFY_PART *p = arg;
+	VERIFY *v = p->v;
+	uint8_t *buf = malloc(VERIFY_BLOCK);
+	uint64_t bufStart = 0, bufEnd = 0, end;
+	uint32_t i;
+
+	if(!buf) {
+		for(i = p->first; i < p->last; i++) v->bad[i] = 2;
+		return NULL;
+	}
+	end = v->movi + v->idx[p->last - 1].offset + sizeof(CHNK) + v->idx[p->last - 1].size;
+	for(i = p->first; i < p->last; i++) {
+		uint64_t pos = v->movi + v->idx[i].offset + sizeof(CHNK);
+		uint32_t left = v->idx[i].size, crc = 0;
+		while(left) {
+			size_t n;
+			if(pos < bufStart || pos >= bufEnd) {
+				size_t want = end - pos > VERIFY_BLOCK ? VERIFY_BLOCK : end - pos;
+				ssize_t got = want ? pread(v->fd, buf, want, pos) : 0;
+				if(got <= 0) break;
+				bufStart = pos;
+				bufEnd = pos + got;
+			}
+			n = bufEnd - pos < left ? bufEnd - pos : left;
+			crc = crc32c(crc, buf + (pos - bufStart), n);
+			pos += n;
+			left -= n;
+		}
+		if(left) v->bad[i] = 2;
+		else if(crc != v->crcs[i]) v->bad[i] = 1;
+		p->bytes += v->idx[i].size - left;
+	}
+	free(buf);
+	return NULL;
+}
+
+/* Finds top level chunks, returns 0 unless `movi', `idx1' and `crcs' are
+ * all present. */
+static int verify_scan(int fd, uint64_t *movi, uint64_t pos[2], uint32_t size[2])
+{
+	struct stat st;
+	uint64_t at = 12, end;
+	struct {
+		CHNK   chnk;
+		FOURCC type;
+	} __attribute__((packed)) hdr;
+
+	if(fstat(fd, &st) < 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	   hdr.chnk.fcc != FOURCC_RIFF || hdr.type != FOURCC_AVI) return 0;
+	/* preallocated or still growing file may be longer than RIFF */
+	end = sizeof(CHNK) + (uint64_t)hdr.chnk.size;
+	if(end > (uint64_t)st.st_size) end = st.st_size;
+	*movi = pos[0] = pos[1] = 0;
+	size[0] = size[1] = 0;
+	while(at + sizeof(CHNK) <= end && pread(fd, &hdr, sizeof(hdr), at) >= (ssize_t)sizeof(CHNK)) {
+		if(hdr.chnk.fcc == FOURCC_LIST && hdr.type == FOURCC_MOVI) {
+			*movi = at + sizeof(CHNK);
+		} else if(hdr.chnk.fcc == FOURCC_IDX1) {
+			pos[0] = at + sizeof(CHNK), size[0] = hdr.chnk.size;
+		} else if(hdr.chnk.fcc == FOURCC_CRCS) {
+			pos[1] = at + sizeof(CHNK), size[1] = hdr.chnk.size;
+		}
+		at += sizeof(CHNK) + hdr.chnk.size + (hdr.chnk.size & 1);
+	}
+	return *movi && pos[0] && pos[1];
+}
+
+int verify_file(const char *path, int threads)
+{
+	VERIFY v;
+	VERIFY_PART *parts;
+	uint64_t pos[2], total = 0, share, bytes = 0, start = stats_now();
+	uint32_t size[2], count, i;
+	int bad = 0, t;
+
+	memset(&v, 0, sizeof(v));
+	if((v.fd = open(path, O_RDONLY)) < 0) return -1;
+	if(!verify_scan(v.fd, &v.movi, pos, size) || size[0] / sizeof(IDX1) != size[1] / sizeof(uint32_t) ||
+	   !(v.idx = malloc(size[0] + 1)) || !(v.crcs = malloc(size[1] + 1)) ||
+	   pread(v.fd, v.idx, size[0], pos[0]) != (ssize_t)size[0] || pread(v.fd, v.crcs, size[1], pos[1]) != (ssize_t)size[1] ||
+	   !(v.bad = calloc(size[0] / sizeof(IDX1) + 1, 1))) {
+		free(v.idx), free(v.crcs);
+		close(v.fd);
+		return -1;
+	}
+	count = size[0] / sizeof(IDX1);
+	posix_fadvise(v.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	if(threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads > (int)count) threads = count;
+	if(threads < 1) threads = 1;
+	if(!(parts = calloc(threads, sizeof(VERIFY_PART)))) {
+		free(v.idx), free(v.crcs), free(v.bad);
+		close(v.fd);
+		return -1;
+	}
+
+	/* contiguous parts of about same size, each read front to back */
+	for(i = 0; i < count; i++) total += v.idx[i].size;
+	share = total / threads + 1;
+	for(t = 0, i = 0; t < threads && i < count; t++) {
+		uint64_t sum = 0;
+		parts[t].v = &v;
+		parts[t].first = i;
+		while(i < count && (sum < share || t == threads - 1)) sum += v.idx[i++].size;
+		parts[t].last = i;
+	}
+	threads = t;
+	for(t = 0; t < threads; t++) {
+		if(!(parts[t].started = !pthread_create(&parts[t].thread, NULL, verify_part, &parts[t]))) {
+			verify_part(&parts[t]);
+		}
+	}
+	for(t = 0; t < threads; t++) {
+		if(parts[t].started) pthread_join(parts[t].thread, NULL);
+		bytes += parts[t].bytes;
+	}
+
+	for(i = 0; i < count; i++) {
+		if(!v.bad[i]) continue;
+		bad++;
+		fprintf(stderr, "Error: Chunk %u `%.4s' at %llu %s in `%s'.\n", i, (const char *)&v.idx[i].id,
+			(unsigned long long)(v.movi + v.idx[i].offset), v.bad[i] == 1 ? "checksum mismatch" : "cannot be read", path);
+	}
+	fprintf(stderr, "Verify `%s' %u chunks, %llu bytes on %d threads in %.3f s, %d bad\n", path, count,
+		(unsigned long long)bytes, threads, (stats_now() - start) / 1e9, bad);
+
+	free(parts);
+	free(v.idx);
+	free(v.crcs);
+	free(v.bad);
+	close(v.fd);
+	return bad;
+}
@@ -0,0 +1,238 @@
+/*
+ * watch.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+
+#include "watch.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <dirent.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+typedef struct {
+	char           *name;
+	struct timespec mtime;
+} WATCH_FILE;
+
+struct WATCH {
+	int    fd;
+	size_t len;  /* valid bytes in events buffer */
+	size_t at;   /* next event in buffer */
+	struct timespec last;  /* mtime of newest file returned, start at first */
+	char   lastName[NAME_MAX + 1];
+	WATCH_FILE *rescan;    /* files found after queue overflow, by mtime */
+	int    rescanCount, rescanAt;
+	struct timespec rescanTime;
+	char   dir[PATH_MAX];
+	char   path[PATH_MAX];
+	char   events[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+};
+
+static int is_jpeg(const char *name)
+{
+	const char *ext = strrchr(name, '.');
+	return ext && (!strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg"));
+}
+
+static int has_eoi(const char *path)
+{
+	unsigned char end[2];
+	FILE *f = fopen(path, "rb");
+	int ret;
+	if(!f) return 0;
+	ret = !fseek(f, -2, SEEK_END) && fread(end, 1, 2, f) == 2 && end[0] == 0xFF && end[1] == 0xD9;
+	fclose(f);
+	return ret;
+}
+
+static int ts_cmp(const struct timespec *a, const struct timespec *b)
+{
+	if(a->tv_sec != b->tv_sec) return a->tv_sec < b->tv_sec ? -1 : 1;
+	if(a->tv_nsec != b->tv_nsec) return a->tv_nsec < b->tv_nsec ? -1 : 1;
+	return 0;
+}
+
+static int file_cmp(const void *a, const void *b)
+{
+	const WATCH_FILE *x = a, *y = b;
+	int c = ts_cmp(&x->mtime, &y->mtime);
+	return c ? c : strcmp(x->name, y->name);
+}
+
+static void watch_forget(WATCH *w)
+{
+	int i;
+	for(i = 0; i < w->rescanCount; i++) free(w->rescan[i].name);
+	free(w->rescan);
+	w->rescan = NULL;
+	w->rescanCount = w->rescanAt = 0;
+}
+
+/* Kernel dropped events, picks up files not older than the last one
+ * returned, in mtime order. */
+static void watch_rescan(WATCH *w)
+{
+	DIR *d;
+	struct dirent *de;
+	int cap = 0;
+	watch_forget(w);
+	clock_gettime(CLOCK_REALTIME, &w->rescanTime);
+	if(!(d = opendir(w->dir))) return;
+	while((de = readdir(d))) {
+		struct stat st;
+		int c;
+		if(!is_jpeg(de->d_name)) continue;
+		if(snprintf(w->path, sizeof(w->path), "%s/%s", w->dir, de->d_name) >= (int)sizeof(w->path)) continue;
+		if(stat(w->path, &st) || !S_ISREG(st.st_mode)) continue;
+		c = ts_cmp(&st.st_mtim, &w->last);
+		if(c < 0 || (c == 0 && !strcmp(de->d_name, w->lastName))) continue;
+		/* file still being written comes later with its close event */
+		if(!has_eoi(w->path)) continue;
+		if(w->rescanCount == cap) {
+			WATCH_FILE *grown = realloc(w->rescan, (cap = cap ? cap * 2 : 256) * sizeof(WATCH_FILE));
+			if(!grown) break;
+			w->rescan = grown;
+		}
+		if(!(w->rescan[w->rescanCount].name = strdup(de->d_name))) break;
+		w->rescan[w->rescanCount++].mtime = st.st_mtim;
+	}
+	closedir(d);
+	qsort(w->rescan, w->rescanCount, sizeof(WATCH_FILE), file_cmp);
+	fprintf(stderr, "Warning: Events of `%s' were lost, rescan found %d new files.\n", w->dir, w->rescanCount);
+}
+
+/* Sets path of file to return, remembering newest one for rescan. Returns
+ * 0 when file was already returned by rescan. */
+static int watch_return(WATCH *w, const char *name, int event)
+{
+	struct stat st;
+	int i;
+	if(snprintf(w->path, sizeof(w->path), "%s/%s", w->dir, name) >= (int)sizeof(w->path)) return 0;
+	if(stat(w->path, &st)) return 1;
+	/* event queued before rescan of file it has seen */
+	if(event && w->rescanCount && ts_cmp(&st.st_mtim, &w->rescanTime) <= 0) {
+		for(i = 0; i < w->rescanAt; i++) {
+			if(!strcmp(w->rescan[i].name, name) && !ts_cmp(&w->rescan[i].mtime, &st.st_mtim)) return 0;
+		}
+	}
+	if(ts_cmp(&st.st_mtim, &w->last) >= 0) {
+		w->last = st.st_mtim;
+		snprintf(w->lastName, sizeof(w->lastName), "%s", name);
+	}
+	return 1;
+}
+
+WATCH *watch_open(const char *dir)
+{
+	WATCH *w = calloc(1, sizeof(WATCH));
+	if(!w) return NULL;
+	snprintf(w->dir, sizeof(w->dir), "%s", dir);
+	clock_gettime(CLOCK_REALTIME, &w->last);
+	/* only complete files, renames are atomic hand-over from writers */
+	if((w->fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) < 0 ||
+	   inotify_add_watch(w->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR) < 0) {
+		if(w->fd >= 0) close(w->fd);
+		free(w);
+		return NULL;
+	}
+	return w;
+}
+
+int watch_next(WATCH *w, int timeout, const char **path)
+{
+	for(;;) {
+		struct pollfd pfd = { w->fd, POLLIN, 0 };
+		ssize_t got;
+		/* files found by rescan come before later events */
+		while(w->rescanAt < w->rescanCount) {
+			if(!watch_return(w, w->rescan[w->rescanAt++].name, 0)) continue;
+			*path = w->path;
+			return 1;
+		}
+		/* drain already read events first */
+		while(w->at < w->len && w->rescanAt == w->rescanCount) {
+			struct inotify_event *ev = (struct inotify_event *)(w->events + w->at);
+			w->at += sizeof(struct inotify_event) + ev->len;
+			if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) return -1;
+			if(ev->mask & IN_Q_OVERFLOW) {
+				watch_rescan(w);
+				continue;
+			}
+			if(ev->mask & IN_ISDIR || !ev->len || !is_jpeg(ev->name)) continue;
+			if(!watch_return(w, ev->name, 1)) continue;
+			*path = w->path;
+			return 1;
+		}
+		if(w->rescanAt < w->rescanCount) continue;
+		w->at = w->len = 0;
+		got = read(w->fd, w->events, sizeof(w->events));
+		if(got > 0) {
+			w->len = got;
+			continue;
+		}
+		if(got < 0 && errno != EAGAIN) return errno == EINTR ? 0 : -1;
+		if(poll(&pfd, 1, timeout) <= 0) return 0;
+	}
+}
+
+void watch_close(WATCH *w)
+{
+	if(!w) return;
+	close(w->fd);
+	watch_forget(w);
+	free(w);
+}
+
+#else
+
+WATCH *watch_open(const char *dir)
+{
+	(void)dir;
+	return NULL;
+}
+
+int watch_next(WATCH *w, int timeout, const char **path)
+{
+	(void)w, (void)timeout, (void)path;
+	return -1;
+}
+
+void watch_close(WATCH *w)
+{
+	(void)w;
+}
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ * writer.c - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "throttle.h"
+#include "writer.h"
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+
+struct WRITER {
+	FILE    *file;
+	int      fd;
+	int      flags;
+	uint8_t *buf;      /* WRITER_ALIGN aligned */
+	size_t   cap;      /* multiple of WRITER_ALIGN */
+	size_t   len;      /* valid bytes in buffer */
+	off_t    start;    /* file offset of buffer, always aligned */
+	off_t    pos;      /* stream position */
+	off_t    size;     /* logical file size */
+	off_t    reserved; /* preallocated size */
+	THROTTLE *throttle; /* optional write rate limit */
+};
+
+#if defined(__GLIBC__)
+
+static int writer_direct(WRITER *w, int on)
+{
+	int fl;
+	if(!(w->flags & WRITER_DIRECT)) return 0;
+	if((fl = fcntl(w->fd, F_GETFL)) < 0) return -1;
+	return fcntl(w->fd, F_SETFL, on ? (fl | O_DIRECT) : (fl & ~O_DIRECT));
+}
+
+static int writer_pwrite(WRITER *w, const uint8_t *ptr, size_t size, off_t off)
+{
+	while(size > 0) {
+		/* chunks stay aligned for O_DIRECT, see throttle_chunk */
+		size_t chunk = throttle_chunk(w->throttle, size);
+		ssize_t wrote;
+		throttle_take(w->throttle, chunk);
+		if((wrote = pwrite(w->fd, ptr, chunk, off)) < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		ptr += wrote;
+		off += wrote;
+		size -= wrote;
+	}
+	return 0;
+}
+
+/* Writes out full buffer, start stays aligned so O_DIRECT is satisfied. */
+static int writer_flush(WRITER *w)
+{
+	off_t from = w->start;
+	if(writer_pwrite(w, w->buf, w->cap, w->start) < 0) return -1;
+	w->start += w->cap;
+	w->len = 0;
+	if((w->flags & WRITER_DONTNEED) && !(w->flags & WRITER_DIRECT)) {
+#ifdef SYNC_FILE_RANGE_WRITE
+		/* kick writeback of this buffer, wait for previous one and drop it */
+		sync_file_range(w->fd, from, w->cap, SYNC_FILE_RANGE_WRITE);
+		if(from >= (off_t)w->cap) {
+			sync_file_range(w->fd, from - w->cap, w->cap,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			posix_fadvise(w->fd, from - w->cap, w->cap, POSIX_FADV_DONTNEED);
+		}
+#else
+		(void)from;
+#endif
+	}
+	return 0;
+}
+
+/* Patches already flushed part of the file, used by header updates. */
+static int writer_patch(WRITER *w, const uint8_t *ptr, size_t size, off_t off)
+{
+	int ret;
+	writer_direct(w, 0);
+	ret = writer_pwrite(w, ptr, size, off);
+	writer_direct(w, 1);
+	return ret;
+}
+
+static ssize_t writer_cookie_write(void *cookie, const char *ptr, size_t size)
+{
+	WRITER *w = cookie;
+	size_t left = size;
+	while(left > 0) {
+		if(w->pos < w->start) {
+			size_t n = MIN(left, (size_t)(w->start - w->pos));
+			if(writer_patch(w, (const uint8_t *)ptr, n, w->pos) < 0) return -1;
+			ptr += n, left -= n, w->pos += n;
+		} else if(w->pos > w->start + (off_t)w->len) {
+			/* seek past written data, fill the gap with zeros */
+			size_t n = MIN((size_t)(w->pos - w->start - w->len), w->cap - w->len);
+			memset(w->buf + w->len, 0, n);
+			w->len += n;
+			if(w->len == w->cap && writer_flush(w) < 0) return -1;
+		} else {
+			size_t at = w->pos - w->start;
+			size_t n = MIN(left, w->cap - at);
+			memcpy(w->buf + at, ptr, n);
+			if(at + n > w->len) w->len = at + n;
+			ptr += n, left -= n, w->pos += n;
+			if(w->len == w->cap && writer_flush(w) < 0) return -1;
+		}
+	}
+	if(w->pos > w->size) w->size = w->pos;
+	return size;
+}
+
+static ssize_t writer_cookie_read(void *cookie, char *ptr, size_t size)
+{
+	WRITER *w = cookie;
+	size_t left = MIN(size, (size_t)(w->size > w->pos ? w->size - w->pos : 0));
+	size_t done = 0;
+	while(left > 0) {
+		size_t n;
+		if(w->pos < w->start) {
+			ssize_t got;
+			n = MIN(left, (size_t)(w->start - w->pos));
+			writer_direct(w, 0);
+			got = pread(w->fd, ptr, n, w->pos);
+			writer_direct(w, 1);
+			if(got <= 0) break;
+			n = got;
+		} else {
+			n = MIN(left, (size_t)(w->start + w->len - w->pos));
+			if(n == 0) break;
+			memcpy(ptr, w->buf + (w->pos - w->start), n);
+		}
+		ptr += n, left -= n, done += n, w->pos += n;
+	}
+	return done;
+}
+
+static int writer_cookie_seek(void *cookie, off64_t *offset, int whence)
+{
+	WRITER *w = cookie;
+	off_t pos = *offset;
+	if(whence == SEEK_CUR) pos += w->pos;
+	else if(whence == SEEK_END) pos += w->size;
+	if(pos < 0) return -1;
+	*offset = w->pos = pos;
+	return 0;
+}
+
+static int writer_cookie_close(void *cookie)
+{
+	WRITER *w = cookie;
+	int ret = 0;
+	/* unaligned tail goes through page cache */
+	if(w->len > 0) {
+		writer_direct(w, 0);
+		ret = writer_pwrite(w, w->buf, w->len, w->start);
+	}
+	if(w->reserved > w->size) ftruncate(w->fd, w->size);
+	if(w->flags & WRITER_DONTNEED) {
+		fdatasync(w->fd);
+		posix_fadvise(w->fd, 0, 0, POSIX_FADV_DONTNEED);
+	}
+	if(close(w->fd) < 0) ret = -1;
+	free(w->buf);
+	free(w);
+	return ret;
+}
+
+WRITER *writer_open(const char *path, size_t bufSize, int flags)
+{
+	cookie_io_functions_t io = {
+		writer_cookie_read, writer_cookie_write, writer_cookie_seek, writer_cookie_close
+	};
+	WRITER *w = calloc(1, sizeof(WRITER));
+	if(!w) return NULL;
+	w->flags = flags;
+	w->cap = (bufSize + WRITER_ALIGN - 1) / WRITER_ALIGN * WRITER_ALIGN;
+	if(w->cap == 0) w->cap = WRITER_BUFSIZE;
+	if(posix_memalign((void **)&w->buf, WRITER_ALIGN, w->cap)) {
+		free(w);
+		return NULL;
+	}
+	w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | ((flags & WRITER_DIRECT) ? O_DIRECT : 0), 0666);
+	if(w->fd < 0 && (flags & WRITER_DIRECT)) {
+		/* filesystem without O_DIRECT support, e.g. tmpfs */
+		w->flags &= ~WRITER_DIRECT;
+		w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	}
+	if(w->fd < 0 || !(w->file = fopencookie(w, "w+", io))) {
+		if(w->fd >= 0) close(w->fd);
+		free(w->buf);
+		free(w);
+		return NULL;
+	}
+	/* writer does all buffering, stdio passes calls straight through */
+	setvbuf(w->file, NULL, _IONBF, 0);
+	return w;
+}
+
+int writer_sync(WRITER *w)
+{
+	int ret = 0;
+	if(!w) return 0;
+	/* buffered tail goes out without advancing, next flush rewrites it */
+	if(w->len > 0) {
+		writer_direct(w, 0);
+		ret = writer_pwrite(w, w->buf, w->len, w->start);
+		writer_direct(w, 1);
+	}
+	return ret;
+}
+
+int writer_reserve(WRITER *w, uint64_t size)
+{
+	if(!w || (off_t)size <= w->reserved) return 0;
+	if(fallocate(w->fd, FALLOC_FL_KEEP_SIZE, 0, size) < 0) return 0;
+	w->reserved = size;
+	return 1;
+}
+
+void writer_throttle(WRITER *w, THROTTLE *t)
+{
+	if(w) w->throttle = t;
+}
+
+#else
+
+/* portable fallback, large stdio buffer only */
+
+WRITER *writer_open(const char *path, size_t bufSize, int flags)
+{
+	WRITER *w = calloc(1, sizeof(WRITER));
+	(void)flags;
+	if(!w) return NULL;
+	if(!(w->file = fopen(path, "w+b"))) {
+		free(w);
+		return NULL;
+	}
+	/* writer itself stays allocated, it only carries the stream */
+	if(bufSize) setvbuf(w->file, NULL, _IOFBF, bufSize);
+	return w;
+}
+
+int writer_sync(WRITER *w)
+{
+	return w ? fflush(w->file) : 0;
+}
+
+int writer_reserve(WRITER *w, uint64_t size)
+{
+	(void)w, (void)size;
+	return 0;
+}
+
+void writer_throttle(WRITER *w, THROTTLE *t)
+{
+	(void)w, (void)t;
+}
+
+#endif
+
+FILE *writer_file(WRITER *w)
+{
+	return w ? w->file : NULL;
+}
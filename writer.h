@@ -0,0 +1,47 @@
+/*
+ * writer.h - MJPEG creator tool (https://github.com/nanoant/mjpeg)
+ *
+ * Copyright (c) 2011 Adam Strzelecki
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define WRITER_DIRECT   0x0001 /* bypass page cache with O_DIRECT */
+#define WRITER_DONTNEED 0x0002 /* drop written pages behind the write front */
+
+#define WRITER_ALIGN   4096
+#define WRITER_BUFSIZE (4*1024*1024) /* default buffer size */
+
+typedef struct WRITER WRITER;
+
+/* Opens output file behind large aligned write buffer. Returned writer owns
+ * FILE stream obtained with writer_file, closing that stream flushes the
+ * tail and releases the writer. Returns NULL if the file cannot be opened. */
+WRITER *writer_open(const char *path, size_t bufSize, int flags);
+FILE *writer_file(WRITER *w);
+/* Makes everything written so far visible in the file, e.g. for readers
+ * of file still being written. */
+int writer_sync(WRITER *w);
+/* Preallocates disk space for expected final size, surplus is released
+ * when the stream is closed. */
+int writer_reserve(WRITER *w, uint64_t size);
+/* Limits write rate with given token bucket, buffer is written out in
+ * chunks sized by throttle_chunk. Requires throttle.h. */
+void writer_throttle(WRITER *w, THROTTLE *t);